@@ -0,0 +1,161 @@
+#define _POSIX_C_SOURCE 199309L // clock_gettime() in -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "display.h"
+#include "triangle.h"
+#include "mesh.h"
+#include "profiler.h"
+#include "scene.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Reproducible benchmark: renders every canonical scene in every render method
+// headless, with a fixed simulated time step, and prints the results as JSON.
+///////////////////////////////////////////////////////////////////////////////
+
+static const char* render_method_names[] = {
+    "wire", "wire_vertex", "fill_triangle", "fill_triangle_wire", "textured", "textured_wire"
+};
+#define NUM_RENDER_METHODS (sizeof(render_method_names) / sizeof(render_method_names[0]))
+
+static double now_seconds(void){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    int width = 1280;
+    int height = 720;
+    int frames = 120;
+    int warmup_frames = 10;
+    float time_step = 1.0 / 60.0;
+    int clip_method = CLIP_FRUSTUM;
+    int pipeline_method = PIPELINE_CAMERA_SPACE;
+    int raster_method = RASTER_EDGE;
+    int threads = 0;
+    bool is_pipelined = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--resolution") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                fprintf(stderr, "--resolution expects WIDTHxHEIGHT, e.g. 1280x720\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--guard-band") == 0) {
+            clip_method = CLIP_GUARD_BAND;
+        } else if (strcmp(argv[i], "--clip-space") == 0) {
+            pipeline_method = PIPELINE_CLIP_SPACE;
+        } else if (strcmp(argv[i], "--scanline") == 0) {
+            raster_method = RASTER_SCANLINE;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pipelined") == 0) {
+            is_pipelined = true;
+        } else {
+            fprintf(stderr, "usage: %s [--resolution WIDTHxHEIGHT] [--frames N] [--guard-band] [--clip-space] [--scanline] [--threads N] [--pipelined]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (frames <= 0) {
+        fprintf(stderr, "--frames must be positive\n");
+        return 1;
+    }
+
+    set_headless(true);
+    set_resolution(width, height);
+    set_num_threads(threads);
+    if (!initialize()) {
+        fprintf(stderr, "initialization() failed\n");
+        return 1;
+    }
+    setup_pipeline();
+    set_fixed_delta_time(time_step);
+
+    printf("{\n  \"resolution\": [%d, %d],\n  \"frames\": %d,\n  \"time_step\": %.6f,\n  \"clip_method\": \"%s\",\n  \"pipeline\": \"%s\",\n  \"raster\": \"%s\",\n  \"threads\": %d,\n  \"pipelined\": %s,\n  \"results\": [",
+           width, height, frames, time_step, clip_method == CLIP_GUARD_BAND ? "guard_band" : "frustum",
+           pipeline_method == PIPELINE_CLIP_SPACE ? "clip_space" : "camera_space",
+           raster_method == RASTER_SCANLINE ? "scanline" : "edge", get_num_threads(), is_pipelined ? "true" : "false");
+
+    bool is_first = true;
+    for (int scene = 0; scene < NUM_SCENES; scene++) {
+        for (int method = 0; method < (int)NUM_RENDER_METHODS; method++) {
+
+            // Every run starts from the same scene state
+            if (!scene_load(scene)) {
+                fprintf(stderr, "scene_load(%s) failed\n", scene_name(scene));
+                return 1;
+            }
+            set_render_method(method);
+            set_clip_method(clip_method);
+            set_pipeline_method(pipeline_method);
+            set_raster_method(raster_method);
+
+            // Pipelined, the first frame after loading comes from update()
+            for (int i = 0; i < warmup_frames; i++) {
+                if (is_pipelined && i > 0) {
+                    update_async();
+                    render();
+                    update_wait();
+                } else {
+                    update();
+                    render();
+                }
+            }
+            // Close the warmup frames, so their counts stay out of the snapshot
+            PROFILE_FRAME_END();
+
+#ifdef PROFILE
+            uint64_t pixels_written = profiler_get_total(PROF_PIXELS_WRITTEN);
+            uint64_t faces_accepted = profiler_get_total(PROF_FACES_ACCEPTED);
+            uint64_t faces_rejected = profiler_get_total(PROF_FACES_REJECTED);
+            uint64_t faces_straddling = profiler_get_total(PROF_FACES_STRADDLING);
+#endif
+            long long triangles = 0;
+            double start = now_seconds();
+            for (int i = 0; i < frames; i++) {
+                if (is_pipelined) {
+                    // Frame i + 1's geometry runs while frame i is rasterized
+                    update_async();
+                    triangles += get_num_triangles_to_render();
+                    render();
+                    update_wait();
+                } else {
+                    update();
+                    triangles += get_num_triangles_to_render();
+                    render();
+                }
+                PROFILE_FRAME_END();
+            }
+            double seconds = now_seconds() - start;
+
+            printf("%s\n    {\"scene\": \"%s\", \"render_method\": \"%s\", \"ms_per_frame\": %.4f, "
+                   "\"triangles_per_frame\": %.1f, \"triangles_per_s\": %.1f, \"frame_pixels_per_s\": %.1f",
+                   is_first ? "" : ",", scene_name(scene), render_method_names[method],
+                   seconds * 1e3 / frames,
+                   (double)triangles / frames,
+                   triangles / seconds,
+                   (double)width * height * frames / seconds);
+#ifdef PROFILE
+            pixels_written = profiler_get_total(PROF_PIXELS_WRITTEN) - pixels_written;
+            printf(", \"pixels_written_per_s\": %.1f", pixels_written / seconds);
+            faces_accepted = profiler_get_total(PROF_FACES_ACCEPTED) - faces_accepted;
+            faces_rejected = profiler_get_total(PROF_FACES_REJECTED) - faces_rejected;
+            faces_straddling = profiler_get_total(PROF_FACES_STRADDLING) - faces_straddling;
+            printf(", \"faces_accepted_per_frame\": %.1f, \"faces_rejected_per_frame\": %.1f, \"faces_straddling_per_frame\": %.1f",
+                   (double)faces_accepted / frames, (double)faces_rejected / frames, (double)faces_straddling / frames);
+#endif
+            printf("}");
+            is_first = false;
+        }
+    }
+    printf("\n  ],\n  \"triangles_high_water_mark\": %d\n}\n", get_triangles_high_water_mark());
+
+    free_mesh();
+    free_triangles_to_render();
+    destroy_display();
+    return 0;
+}
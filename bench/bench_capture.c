@@ -0,0 +1,198 @@
+#define _POSIX_C_SOURCE 199309L // clock_gettime() in -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "display.h"
+#include "triangle.h"
+#include "mesh.h"
+#include "capture.h"
+#include "image.h"
+#include "scene.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Microbenchmark: the capture image formats on rendered frames of every
+// canonical scene, downscaled as captured. Time per encoded and written file,
+// and file size against raw RGBA. Prints JSON. Exits with 1, when a QOI file
+// does not decode to the captured pixels.
+///////////////////////////////////////////////////////////////////////////////
+
+#define WIDTH 1280
+#define HEIGHT 720
+#define WARMUP_FRAMES 10
+#define NUM_REPETITIONS 10
+
+static const int formats[] = { IMAGE_PNG, IMAGE_QOI, IMAGE_PPM };
+
+static double now_seconds(void){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static long file_size(const char* path){
+    FILE* file = fopen(path, "rb");
+    if (file == NULL){
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+static uint8_t* read_file(const char* path, long* size){
+    *size = file_size(path);
+    FILE* file = fopen(path, "rb");
+    if (file == NULL || *size < 0){
+        return NULL;
+    }
+    uint8_t* data = (uint8_t*)malloc(*size);
+    if (data != NULL && fread(data, 1, *size, file) != (size_t)*size){
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+/**
+ * @brief decodes a 4 channel QOI image of the given size into rgba, tightly
+ *        packed, the reverse of qoi_encode().
+ *
+ * @return returns false, when the data is not such an image or is truncated.
+ */
+static bool qoi_decode(const uint8_t* data, long size, int width, int height, uint8_t* rgba){
+    if (size < 14 + 8 || memcmp(data, "qoif", 4) != 0 || data[12] != 4){
+        return false;
+    }
+    uint32_t w = (uint32_t)data[4] << 24 | data[5] << 16 | data[6] << 8 | data[7];
+    uint32_t h = (uint32_t)data[8] << 24 | data[9] << 16 | data[10] << 8 | data[11];
+    if (w != (uint32_t)width || h != (uint32_t)height){
+        return false;
+    }
+
+    uint8_t index[64][4];
+    memset(index, 0, sizeof(index));
+    uint8_t px[4] = { 0, 0, 0, 255 };
+    const uint8_t* p = data + 14;
+    const uint8_t* end = data + size - 8;
+    int run = 0;
+    for (long i = 0; i < (long)width * height; i++){
+        if (run > 0){
+            run--;
+        } else {
+            if (p >= end){
+                return false;
+            }
+            int op = *p++;
+            if (op == 0xFE || op == 0xFF){ // QOI_OP_RGB, QOI_OP_RGBA
+                int n = op == 0xFE ? 3 : 4;
+                if (end - p < n){
+                    return false;
+                }
+                memcpy(px, p, n);
+                p += n;
+            } else if ((op & 0xC0) == 0x00){ // QOI_OP_INDEX
+                memcpy(px, index[op], 4);
+            } else if ((op & 0xC0) == 0x40){ // QOI_OP_DIFF
+                px[0] += ((op >> 4) & 3) - 2;
+                px[1] += ((op >> 2) & 3) - 2;
+                px[2] += (op & 3) - 2;
+            } else if ((op & 0xC0) == 0x80){ // QOI_OP_LUMA
+                if (p >= end){
+                    return false;
+                }
+                int dg = (op & 0x3F) - 32;
+                px[0] += dg - 8 + (*p >> 4);
+                px[1] += dg;
+                px[2] += dg - 8 + (*p & 0x0F);
+                p++;
+            } else { // QOI_OP_RUN
+                run = op & 0x3F;
+            }
+            memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+        }
+        memcpy(rgba + 4 * i, px, 4);
+    }
+    return true;
+}
+
+int main(void) {
+    set_headless(true);
+    set_resolution(WIDTH, HEIGHT);
+    if (!initialize()) {
+        fprintf(stderr, "initialization() failed\n");
+        return 1;
+    }
+    setup_pipeline();
+    set_fixed_delta_time(1.0 / 60.0);
+
+    capture_frame_t frame = { 0, WIDTH / 2, HEIGHT / 2, WIDTH / 2 * 4, NULL };
+    frame.pixels = (uint8_t*)malloc((size_t)frame.pitch * frame.height);
+    uint8_t* decoded = (uint8_t*)malloc((size_t)frame.pitch * frame.height);
+    if (!frame.pixels || !decoded) {
+        fprintf(stderr, "Setup failed\n");
+        return 1;
+    }
+
+    printf("{\n  \"resolution\": [%d, %d],\n  \"frame\": [%d, %d],\n  \"repetitions\": %d,\n  \"results\": [",
+           WIDTH, HEIGHT, frame.width, frame.height, NUM_REPETITIONS);
+
+    bool is_first = true;
+    bool is_mismatch = false;
+    for (int scene = 0; scene < NUM_SCENES; scene++) {
+        if (!scene_load(scene)) {
+            fprintf(stderr, "scene_load(%s) failed\n", scene_name(scene));
+            return 1;
+        }
+        set_render_method(RENDER_TEXTURED);
+        for (int i = 0; i < WARMUP_FRAMES; i++) {
+            update();
+            render();
+        }
+        capture_downscale_2x(&frame, get_color_buffer(), WIDTH, 0, frame.height);
+
+        for (int f = 0; f < (int)(sizeof(formats) / sizeof(formats[0])); f++) {
+            char path[64];
+            snprintf(path, sizeof(path), "./build/bench_capture.%s", image_format_extension(formats[f]));
+            double seconds = 0;
+            for (int r = 0; r < NUM_REPETITIONS; r++) {
+                double start = now_seconds();
+                if (!image_write(path, formats[f], frame.pixels, frame.width, frame.height, frame.pitch)) {
+                    return 1;
+                }
+                seconds += now_seconds() - start;
+            }
+            long size = file_size(path);
+
+            // The QOI file must decode to the captured pixels
+            if (formats[f] == IMAGE_QOI) {
+                long encoded_size = 0;
+                uint8_t* encoded = read_file(path, &encoded_size);
+                if (encoded == NULL || !qoi_decode(encoded, encoded_size, frame.width, frame.height, decoded) ||
+                    memcmp(decoded, frame.pixels, (size_t)frame.pitch * frame.height) != 0) {
+                    fprintf(stderr, "%s: the QOI file does not decode to the captured frame\n", scene_name(scene));
+                    is_mismatch = true;
+                }
+                free(encoded);
+            }
+            remove(path);
+            printf("%s\n    {\"scene\": \"%s\", \"format\": \"%s\", \"ms\": %.3f, \"mpixels_per_s\": %.3f, "
+                   "\"bytes\": %ld, \"ratio\": %.4f}",
+                   is_first ? "" : ",", scene_name(scene), image_format_extension(formats[f]),
+                   seconds * 1e3 / NUM_REPETITIONS,
+                   (double)frame.width * frame.height * NUM_REPETITIONS / seconds / 1e6,
+                   size, (double)size / ((size_t)frame.width * frame.height * 4));
+            is_first = false;
+        }
+    }
+    printf("\n  ]\n}\n");
+
+    free(decoded);
+    free(frame.pixels);
+    free_mesh();
+    free_triangles_to_render();
+    destroy_display();
+    return is_mismatch ? 1 : 0;
+}
@@ -0,0 +1,153 @@
+#define _POSIX_C_SOURCE 199309L // clock_gettime() in -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "triangle.h"
+#include "scene.h"
+#include "cpu.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Microbenchmark: the scanline rasterizer against the edge function rasterizer
+// in every SIMD level the CPU supports, for small, medium and large triangles,
+// flat and textured. Prints JSON. Exits with 1, when a SIMD level writes other
+// colors or depths than the scalar edge rasterizer.
+///////////////////////////////////////////////////////////////////////////////
+
+#define WIDTH 1280
+#define HEIGHT 720
+#define NUM_TRIANGLES 4096
+#define NUM_REPETITIONS 5
+
+static const char* raster_names[] = { "scanline", "edge" };
+static const char* mode_names[] = { "flat", "textured" };
+static const int triangle_sizes[] = { 8, 64, 512 };
+
+static double now_seconds(void){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static float random_float(float min, float max){
+    return min + rand() / (float)RAND_MAX * (max - min);
+}
+
+/**
+ * @brief builds random screen triangles with vertices within size pixels of
+ *        a random center, at random depths.
+ */
+static void random_triangles(screen_triangle_t* triangles, int size){
+    for (int i = 0; i < NUM_TRIANGLES; i++){
+        float cx = random_float(0, WIDTH);
+        float cy = random_float(0, HEIGHT);
+        for (int j = 0; j < 3; j++){
+            triangles[i].x[j] = edge_snap(cx + random_float(-size, size) / 2);
+            triangles[i].y[j] = edge_snap(cy + random_float(-size, size) / 2);
+            triangles[i].inv_w[j] = 1.0 / random_float(2, 50);
+            triangles[i].uv[j] = tex2_pack((tex2_t){ random_float(0, 1), random_float(0, 1) });
+        }
+        triangles[i].color = 0xFF000000 | (uint32_t)rand();
+        triangles[i].material = 0;
+    }
+}
+
+static void draw(const screen_triangle_t* t, int raster, int mode, upng_t* texture,
+                 color_t* color_buffer, float* z_buffer){
+    if (raster == 1 && mode == 0){
+        draw_filled_triangle_edge(t, NULL, WIDTH, HEIGHT, color_buffer, z_buffer);
+    } else if (raster == 1){
+        draw_textured_triangle_edge(t, texture, NULL, WIDTH, HEIGHT, color_buffer, z_buffer);
+    } else {
+        int x[3], y[3];
+        float w[3];
+        for (int j = 0; j < 3; j++){
+            x[j] = t->x[j] >> SUBPIXEL_BITS;
+            y[j] = t->y[j] >> SUBPIXEL_BITS;
+            w[j] = 1.0 / t->inv_w[j];
+        }
+        if (mode == 0){
+            draw_filled_triangle(x[0], y[0], 0, w[0], x[1], y[1], 0, w[1], x[2], y[2], 0, w[2],
+                                 t->color, WIDTH, HEIGHT, color_buffer, z_buffer);
+        } else {
+            draw_textured_triangle(x[0], y[0], 0, w[0], tex2_unpack(t->uv[0]), x[1], y[1], 0, w[1], tex2_unpack(t->uv[1]),
+                                   x[2], y[2], 0, w[2], tex2_unpack(t->uv[2]), texture, WIDTH, HEIGHT, color_buffer, z_buffer);
+        }
+    }
+}
+
+int main(void) {
+    color_t* color_buffer = (color_t*)malloc(sizeof(color_t) * WIDTH * HEIGHT);
+    float* z_buffer = (float*)malloc(sizeof(float) * WIDTH * HEIGHT);
+    color_t* scalar_color_buffer = (color_t*)malloc(sizeof(color_t) * WIDTH * HEIGHT);
+    float* scalar_z_buffer = (float*)malloc(sizeof(float) * WIDTH * HEIGHT);
+    screen_triangle_t* triangles = (screen_triangle_t*)malloc(sizeof(screen_triangle_t) * NUM_TRIANGLES);
+    upng_t* texture = scene_texture();
+    if (!color_buffer || !z_buffer || !scalar_color_buffer || !scalar_z_buffer || !triangles || !texture) {
+        fprintf(stderr, "Setup failed\n");
+        return 1;
+    }
+
+    printf("{\n  \"resolution\": [%d, %d],\n  \"triangles\": %d,\n  \"repetitions\": %d,\n  \"results\": [",
+           WIDTH, HEIGHT, NUM_TRIANGLES, NUM_REPETITIONS);
+
+    bool is_first = true;
+    bool is_mismatch = false;
+    for (int s = 0; s < (int)(sizeof(triangle_sizes) / sizeof(triangle_sizes[0])); s++) {
+        srand(1);
+        random_triangles(triangles, triangle_sizes[s]);
+
+        for (int mode = 0; mode < 2; mode++) {
+            // the scanline rasterizer, then the edge rasterizer per SIMD level
+            for (int run = 0; run <= 1 + SIMD_AVX2; run++) {
+                int raster = run == 0 ? 0 : 1;
+                int level = run == 0 ? SIMD_SCALAR : run - 1;
+                cpu_set_simd_level(level);
+                if (cpu_simd_level() != level) {
+                    continue; // not supported by this CPU
+                }
+                double seconds = 0;
+                for (int r = 0; r < NUM_REPETITIONS; r++) {
+                    memset(color_buffer, 0, sizeof(color_t) * WIDTH * HEIGHT);
+                    for (int i = 0; i < WIDTH * HEIGHT; i++) {
+                        z_buffer[i] = 100.0f;
+                    }
+                    double start = now_seconds();
+                    for (int i = 0; i < NUM_TRIANGLES; i++) {
+                        draw(&triangles[i], raster, mode, texture, color_buffer, z_buffer);
+                    }
+                    seconds += now_seconds() - start;
+                }
+                // The SIMD levels must write the same buffers as the scalar edge rasterizer
+                bool is_equal = true;
+                if (raster == 1 && level == SIMD_SCALAR) {
+                    memcpy(scalar_color_buffer, color_buffer, sizeof(color_t) * WIDTH * HEIGHT);
+                    memcpy(scalar_z_buffer, z_buffer, sizeof(float) * WIDTH * HEIGHT);
+                } else if (raster == 1) {
+                    is_equal = memcmp(scalar_color_buffer, color_buffer, sizeof(color_t) * WIDTH * HEIGHT) == 0 &&
+                               memcmp(scalar_z_buffer, z_buffer, sizeof(float) * WIDTH * HEIGHT) == 0;
+                    if (!is_equal) {
+                        fprintf(stderr, "%s %s triangles of size %d differ from scalar\n",
+                                cpu_simd_level_name(level), mode_names[mode], triangle_sizes[s]);
+                        is_mismatch = true;
+                    }
+                }
+                printf("%s\n    {\"size\": %d, \"mode\": \"%s\", \"raster\": \"%s\", \"simd\": \"%s\", \"ms\": %.3f, \"mtriangles_per_s\": %.3f, \"equal\": %s}",
+                       is_first ? "" : ",", triangle_sizes[s], mode_names[mode], raster_names[raster], cpu_simd_level_name(level),
+                       seconds * 1e3 / NUM_REPETITIONS,
+                       (double)NUM_TRIANGLES * NUM_REPETITIONS / seconds / 1e6,
+                       is_equal ? "true" : "false");
+                is_first = false;
+            }
+        }
+    }
+    printf("\n  ]\n}\n");
+
+    upng_free(texture);
+    free(triangles);
+    free(scalar_z_buffer);
+    free(scalar_color_buffer);
+    free(z_buffer);
+    free(color_buffer);
+    return is_mismatch ? 1 : 0;
+}
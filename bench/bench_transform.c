@@ -0,0 +1,113 @@
+#define _POSIX_C_SOURCE 199309L // clock_gettime() in -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "cpu.h"
+#include "matrix.h"
+#include "vector.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Microbenchmark: per-vertex mat4_mul_vec4() against mat4_mul_vec4_batch() in
+// every SIMD level the CPU supports. Prints the results as JSON. Exits with 1,
+// when a SIMD level's batch differs from the scalar batch in any bit.
+///////////////////////////////////////////////////////////////////////////////
+
+#define NUM_VERTICES (1 << 20)
+#define NUM_REPETITIONS 50
+
+static double now_seconds(void){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(void) {
+    vec4_t* vertices = (vec4_t*)malloc(sizeof(vec4_t) * NUM_VERTICES);
+    vec4_t* reference = (vec4_t*)malloc(sizeof(vec4_t) * NUM_VERTICES);
+    vec4_soa_t in;
+    vec4_soa_t out;
+    vec4_soa_t scalar_out;
+    if (!vertices || !reference || !vec4_soa_alloc(&in, NUM_VERTICES, false) || !vec4_soa_alloc(&out, NUM_VERTICES, true) ||
+        !vec4_soa_alloc(&scalar_out, NUM_VERTICES, true)) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+
+    srand(1);
+    for (int i = 0; i < NUM_VERTICES; i++) {
+        vertices[i].x = in.x[i] = rand() / (float)RAND_MAX * 10.0 - 5.0;
+        vertices[i].y = in.y[i] = rand() / (float)RAND_MAX * 10.0 - 5.0;
+        vertices[i].z = in.z[i] = rand() / (float)RAND_MAX * 10.0 - 5.0;
+        vertices[i].w = 1.0;
+    }
+
+    // a typical model-view-projection matrix
+    mat4_t m = mat4_mul_mat4(mat4_make_rotation_y(0.3), mat4_make_rotation_x(0.7));
+    m = mat4_mul_mat4(mat4_make_translation(1, -2, 8), m);
+    m = mat4_mul_mat4(mat4_look_at(vec3_new(0, 1, -3), vec3_new(0, 0, 8), vec3_new(0, 1, 0)), m);
+    m = mat4_mul_mat4(mat4_make_perspective(1.047, 0.5625, 1.0, 100.0), m);
+
+    printf("{\n  \"vertices\": %d,\n  \"repetitions\": %d,\n  \"results\": [", NUM_VERTICES, NUM_REPETITIONS);
+
+    // the scalar per-vertex path, by value
+    double start = now_seconds();
+    for (int r = 0; r < NUM_REPETITIONS; r++) {
+        for (int i = 0; i < NUM_VERTICES; i++) {
+            reference[i] = mat4_mul_vec4(m, vertices[i]);
+        }
+    }
+    double seconds = now_seconds() - start;
+    printf("\n    {\"kernel\": \"mat4_mul_vec4\", \"ns_per_vertex\": %.3f, \"mvertices_per_s\": %.1f}",
+           seconds * 1e9 / ((double)NUM_VERTICES * NUM_REPETITIONS), (double)NUM_VERTICES * NUM_REPETITIONS / seconds / 1e6);
+
+    bool is_mismatch = false;
+    for (int level = SIMD_SCALAR; level <= SIMD_AVX2; level++) {
+        cpu_set_simd_level(level);
+        if (cpu_simd_level() != level) {
+            continue; // not supported by this CPU
+        }
+        start = now_seconds();
+        for (int r = 0; r < NUM_REPETITIONS; r++) {
+            mat4_mul_vec4_batch(&m, &in, &out, NUM_VERTICES);
+        }
+        seconds = now_seconds() - start;
+
+        float max_error = 0;
+        for (int i = 0; i < NUM_VERTICES; i++) {
+            max_error = fmaxf(max_error, fabsf(out.x[i] - reference[i].x));
+            max_error = fmaxf(max_error, fabsf(out.y[i] - reference[i].y));
+            max_error = fmaxf(max_error, fabsf(out.z[i] - reference[i].z));
+            max_error = fmaxf(max_error, fabsf(out.w[i] - reference[i].w));
+        }
+
+        // All levels evaluate the same sums in the same order: exactly equal
+        int mismatches = 0;
+        for (int i = 0; i < NUM_VERTICES; i++) {
+            if (level == SIMD_SCALAR) {
+                scalar_out.x[i] = out.x[i];
+                scalar_out.y[i] = out.y[i];
+                scalar_out.z[i] = out.z[i];
+                scalar_out.w[i] = out.w[i];
+            } else if (out.x[i] != scalar_out.x[i] || out.y[i] != scalar_out.y[i] ||
+                       out.z[i] != scalar_out.z[i] || out.w[i] != scalar_out.w[i]) {
+                mismatches++;
+            }
+        }
+        if (mismatches > 0) {
+            fprintf(stderr, "%s: %d vertices differ from scalar\n", cpu_simd_level_name(level), mismatches);
+            is_mismatch = true;
+        }
+        printf(",\n    {\"kernel\": \"mat4_mul_vec4_batch\", \"simd\": \"%s\", \"ns_per_vertex\": %.3f, \"mvertices_per_s\": %.1f, \"max_error\": %g, \"mismatches\": %d}",
+               cpu_simd_level_name(level), seconds * 1e9 / ((double)NUM_VERTICES * NUM_REPETITIONS),
+               (double)NUM_VERTICES * NUM_REPETITIONS / seconds / 1e6, max_error, mismatches);
+    }
+    printf("\n  ]\n}\n");
+
+    vec4_soa_free(&in);
+    vec4_soa_free(&out);
+    vec4_soa_free(&scalar_out);
+    free(vertices);
+    free(reference);
+    return is_mismatch ? 1 : 0;
+}
@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <math.h>
+#include "scene.h"
+#include "array.h"
+#include "mesh.h"
+#include "upng.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// 16x16 RGBA checkerboard, shared by all meshes of the benchmark scenes.
+static const unsigned char checker_png[] = {
+    0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A, 0x00, 0x00, 0x00, 0x0D,
+    0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x10,
+    0x08, 0x06, 0x00, 0x00, 0x00, 0x1F, 0xF3, 0xFF, 0x61, 0x00, 0x00, 0x00,
+    0x28, 0x49, 0x44, 0x41, 0x54, 0x78, 0xDA, 0x63, 0x30, 0x48, 0x38, 0xF0,
+    0x1F, 0x19, 0x3F, 0x78, 0xF0, 0x00, 0x05, 0x13, 0x92, 0x67, 0x18, 0x06,
+    0x06, 0x90, 0xAA, 0x01, 0x5D, 0x7E, 0x38, 0x18, 0x30, 0x9A, 0x0E, 0x46,
+    0xD3, 0x01, 0x10, 0x03, 0x00, 0x4B, 0xDB, 0xF7, 0x1F, 0x4C, 0xCF, 0x52,
+    0x8A, 0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4E, 0x44, 0xAE, 0x42, 0x60,
+    0x82,
+};
+
+static const char* scene_names[NUM_SCENES] = {
+    "fill_rate", "geometry", "many_meshes", "clipping"
+};
+
+const char* scene_name(int scene){
+    return scene_names[scene];
+}
+
+/**
+ * @brief decodes the checkerboard texture. Each mesh owns its own texture,
+ *        free_mesh() releases it.
+ *
+ * @param
+ * @return
+ */
+upng_t* scene_texture(void){
+    upng_t* texture = upng_new_from_bytes(checker_png, sizeof(checker_png));
+    if (texture == NULL){
+        return NULL;
+    }
+    upng_decode(texture);
+    if (upng_get_error(texture) != UPNG_EOK){
+        upng_free(texture);
+        return NULL;
+    }
+    return texture;
+}
+
+static face_t scene_face(int a, int b, int c, int a_uv, int b_uv, int c_uv){
+    face_t face = {
+        .a = a, .b = b, .c = c,
+        .a_uv = a_uv, .b_uv = b_uv, .c_uv = c_uv,
+        .color = 0xFFFFFFFF
+    };
+    return face;
+}
+
+/**
+ * @brief adds a grid of nx by ny quads in the xy-plane, facing -z.
+ *
+ * @param size: edge length of the whole grid
+ *        double_sided: adds every face twice, with both windings
+ * @return
+ */
+static bool scene_add_grid(int nx, int ny, float size, bool double_sided, vec3_t translation){
+    vec3_t* vertices = NULL;
+    face_t* faces = NULL;
+    tex2_t* texcoords = NULL;
+
+    // texture coordinate numbers of the four corners of a cell
+    enum { T00, T10, T01, T11 };
+    tex2_t corners[4] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 1 } };
+    for (int i = 0; i < 4; i++){
+        array_push(texcoords, corners[i]);
+    }
+
+    for (int j = 0; j <= ny; j++){
+        for (int i = 0; i <= nx; i++){
+            vec3_t vertex = { size * ((float)i / nx - 0.5), size * ((float)j / ny - 0.5), 0 };
+            array_push(vertices, vertex);
+        }
+    }
+    for (int j = 0; j < ny; j++){
+        for (int i = 0; i < nx; i++){
+            int v00 = j * (nx + 1) + i;
+            int v10 = v00 + 1;
+            int v01 = v00 + nx + 1;
+            int v11 = v01 + 1;
+            array_push(faces, scene_face(v00, v01, v10, T00, T01, T10));
+            array_push(faces, scene_face(v10, v01, v11, T10, T01, T11));
+            if (double_sided){
+                array_push(faces, scene_face(v00, v10, v01, T00, T10, T01));
+                array_push(faces, scene_face(v10, v11, v01, T10, T11, T01));
+            }
+        }
+    }
+    return load_mesh_data(vertices, faces, texcoords, scene_texture(), vec3_new(1, 1, 1), translation, vec3_new(0, 0, 0));
+}
+
+/**
+ * @brief adds a UV sphere with outward facing triangles.
+ *
+ * @param rings, segments: tessellation in latitude and longitude
+ * @return
+ */
+static bool scene_add_sphere(int rings, int segments, float radius, vec3_t translation){
+    vec3_t* vertices = NULL;
+    face_t* faces = NULL;
+    tex2_t* texcoords = NULL; // one per vertex, same numbers
+
+    for (int i = 0; i <= rings; i++){
+        float theta = M_PI * i / rings;
+        for (int j = 0; j <= segments; j++){
+            float phi = 2.0 * M_PI * j / segments;
+            vec3_t vertex = {
+                radius * sin(theta) * cos(phi),
+                radius * cos(theta),
+                radius * sin(theta) * sin(phi)
+            };
+            tex2_t texcoord = { (float)j / segments, 1.0 - (float)i / rings };
+            array_push(vertices, vertex);
+            array_push(texcoords, texcoord);
+        }
+    }
+    for (int i = 0; i < rings; i++){
+        for (int j = 0; j < segments; j++){
+            int a = i * (segments + 1) + j;
+            int b = a + segments + 1;
+            array_push(faces, scene_face(a, a + 1, b, a, a + 1, b));
+            array_push(faces, scene_face(a + 1, b + 1, b, a + 1, b + 1, b));
+        }
+    }
+    return load_mesh_data(vertices, faces, texcoords, scene_texture(), vec3_new(1, 1, 1), translation, vec3_new(0, 0, 0));
+}
+
+/**
+ * @brief replaces all meshes with the given canonical scene.
+ *
+ * @param scene: one of enum scene_id
+ * @return returns true, when all meshes of the scene are loaded.
+ */
+bool scene_load(int scene){
+    free_mesh();
+
+    switch (scene){
+    case SCENE_FILL_RATE:
+        // four screen-filling, double-sided quads behind each other
+        for (int i = 0; i < 4; i++){
+            if (!scene_add_grid(1, 1, 8.0, true, vec3_new(0, 0, 5 + i))){
+                return false;
+            }
+        }
+        return true;
+    case SCENE_GEOMETRY:
+        return scene_add_sphere(64, 128, 2.5, vec3_new(0, 0, 6));
+    case SCENE_MANY_MESHES:
+        for (int j = 0; j < 10; j++){
+            for (int i = 0; i < 10; i++){
+                if (!scene_add_sphere(6, 12, 0.4, vec3_new(i - 4.5, j - 4.5, 12))){
+                    return false;
+                }
+            }
+        }
+        return true;
+    case SCENE_CLIPPING:
+        // the camera is inside the sphere and the grid reaches beyond the far plane
+        return scene_add_sphere(32, 64, 4.0, vec3_new(0, 0, 2)) &&
+               scene_add_grid(32, 32, 300.0, true, vec3_new(0, -2, 20));
+    }
+    return false;
+}
@@ -0,0 +1,22 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdbool.h>
+#include "upng.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Canonical benchmark scenes, built procedurally so that no asset is needed.
+///////////////////////////////////////////////////////////////////////////////
+enum scene_id {
+    SCENE_FILL_RATE,    // a few large, overlapping triangles (overdraw)
+    SCENE_GEOMETRY,     // one dense mesh of many small triangles
+    SCENE_MANY_MESHES,  // a grid of many small meshes
+    SCENE_CLIPPING,     // large meshes crossing the near and the side planes
+    NUM_SCENES
+};
+
+const char* scene_name(int scene);
+bool scene_load(int scene);
+upng_t* scene_texture(void);
+
+#endif // SCENE_H
@@ -50,6 +50,7 @@ float get_zfar(void);
 mat4_t get_proj_mat(void); // projection matrix
 mat4_t get_view_mat(void); // look_at matrix
 mat4_t get_world_mat(void);
+int get_matrix_version(void); // changes with the view or the projection matrix
 camera_t get_camera(void);
 float get_camera_yaw(void);
 float get_camera_pitch(void);
@@ -0,0 +1,58 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Asynchronous frame capture: a ring of preallocated frame buffers, filled by
+// the render loop and written by background encoder threads.
+///////////////////////////////////////////////////////////////////////////////
+// capture_acquire() hands out a free buffer, capture_submit() queues it for
+// the encoders, which return it to the ring once it is written. When every
+// buffer is in use, the policy decides: wait for one (block), skip the frame
+// (drop), or allocate another buffer (grow).
+///////////////////////////////////////////////////////////////////////////////
+
+enum capture_policy {
+    CAPTURE_BLOCK,
+    CAPTURE_DROP,
+    CAPTURE_GROW
+};
+
+typedef struct {
+    int index;       // number of the captured frame, set by the caller
+    int width;
+    int height;
+    int pitch;       // bytes per row
+    uint8_t* pixels; // RGBA, byte order R, G, B, A as in the color buffer
+} capture_frame_t;
+
+// Writes one frame, called on an encoder thread. Returns false on failure.
+typedef bool (*capture_writer_t)(const capture_frame_t* frame, void* user_data);
+
+typedef struct {
+    int frames_submitted;
+    int frames_written;
+    int frames_failed;
+    int frames_dropped;    // no free buffer, with CAPTURE_DROP
+    int num_buffers;       // buffers in the ring, more after CAPTURE_GROW
+    int max_queue_depth;   // frames waiting for an encoder, at submit
+    double mean_queue_depth;
+    double encode_ms_mean;
+    double encode_ms_max;
+    double blocked_ms;     // time capture_acquire() waited, with CAPTURE_BLOCK
+} capture_stats_t;
+
+bool capture_init(int width, int height, int num_buffers, int num_encoders, int policy,
+                  capture_writer_t writer, void* user_data);
+capture_frame_t* capture_acquire(void);
+void capture_submit(capture_frame_t* frame);
+void capture_release(capture_frame_t* frame);
+void capture_flush(void);
+void capture_shutdown(void);
+void capture_downscale_2x(capture_frame_t* frame, const uint32_t* src, int src_width, int first_row, int end_row);
+capture_stats_t capture_get_stats(void);
+const char* capture_policy_name(int policy);
+
+#endif // CAPTURE_H
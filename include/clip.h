@@ -12,7 +12,30 @@ enum {
     TOP_FRUSTUM_PLANE,
     BOTTOM_FRUSTUM_PLANE,
     NEAR_FRUSTUM_PLANE,
-    FAR_FRUSTUM_PLANE
+    FAR_FRUSTUM_PLANE,
+    LEFT_GUARD_BAND_PLANE,  // side planes widened by GUARD_BAND_SCALE
+    RIGHT_GUARD_BAND_PLANE,
+    TOP_GUARD_BAND_PLANE,
+    BOTTOM_GUARD_BAND_PLANE
+};
+
+// Guard band: triangles that only cross the side planes are not clipped, the
+// rasterizer clamps them to the viewport instead. Only triangles reaching
+// beyond GUARD_BAND_SCALE times the viewport extent (in NDC) get clipped, so
+// their screen coordinates stay far away from integer overflow.
+#define GUARD_BAND_SCALE 4.0
+
+// per-vertex outcode: one bit per plane the vertex is not inside of
+typedef unsigned short outcode_t;
+#define OUTCODE_FRUSTUM_PLANES 0x03F
+#define OUTCODE_NEAR_FAR_PLANES ((1 << NEAR_FRUSTUM_PLANE) | (1 << FAR_FRUSTUM_PLANE))
+#define OUTCODE_GUARD_BAND_PLANES 0x3C0
+
+// result of a bounding volume test against the frustum
+enum {
+    FRUSTUM_OUTSIDE,   // completely outside of at least one plane
+    FRUSTUM_INSIDE,    // completely inside of all planes, no clipping needed
+    FRUSTUM_INTERSECT  // straddles at least one plane
 };
 
 typedef struct {
@@ -26,13 +49,33 @@ typedef struct {
     int num_vertices;
 } polygon_t;
 
+typedef struct {
+    vec4_t vertices[MAX_NUM_POLYGON_VERTICES]; // homogeneous clip-space vertices
+    tex2_t texcoords[MAX_NUM_POLYGON_VERTICES];
+    int num_vertices;
+} polygon4_t;
+
 float float_lerp(float a, float b, float t);
 void init_frustum_planes(float fov_x, float fov_y, float znear, float zfar);
 void triangles_from_polygon(polygon_t* polygon, triangle_t triangles[], int* num_traingles);
 polygon_t polygon_from_triangle(vec3_t v0, vec3_t v1, vec3_t v2, tex2_t t0, tex2_t t1, tex2_t t2);
 
+int frustum_classify_sphere(vec3_t center, float radius);
+int frustum_classify_points(vec3_t points[], int num_points);
+
+void compute_outcodes(const vec4_soa_t* vertices, outcode_t outcodes[], int count);
+
 void clip_polygon_against_plane(polygon_t* polygon, int plane);
+void clip_polygon_against_planes(polygon_t* polygon, outcode_t plane_mask);
 void clip_polygon(polygon_t* polygon);
 
+// homogeneous clip space (after the projection matrix, before the divide)
+outcode_t clip_space_outcode(vec4_t v);
+void compute_clip_space_outcodes(const vec4_soa_t* vertices, outcode_t outcodes[], int count);
+int frustum_classify_clip_points(vec4_t points[], int num_points);
+polygon4_t polygon4_from_triangle(vec4_t v0, vec4_t v1, vec4_t v2, tex2_t t0, tex2_t t1, tex2_t t2);
+void clip_polygon4_against_planes(polygon4_t* polygon, outcode_t plane_mask);
+void triangles_from_polygon4(polygon4_t* polygon, triangle_t triangles[], int* num_triangles);
+
 
 #endif // CLIP_H
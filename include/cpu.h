@@ -0,0 +1,15 @@
+#ifndef CPU_H
+#define CPU_H
+
+// SIMD instruction sets the kernels can dispatch to, in increasing order.
+enum simd_level {
+    SIMD_SCALAR,
+    SIMD_SSE,   // SSE4.1, 4 floats per instruction
+    SIMD_AVX2   // AVX2, 8 floats per instruction
+};
+
+int cpu_simd_level(void);
+void cpu_set_simd_level(int level);
+const char* cpu_simd_level_name(int level);
+
+#endif // CPU_H
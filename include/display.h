@@ -10,12 +10,27 @@
 #define FPS 60
 #define FRAME_TARGET_TIME (1000/FPS) // 1000 ms = 1 sec, depends on FPS
 
-// render/cull mode enums
+// render/cull/clip/pipeline/raster mode enums
 enum cull_method {
     CULL_NONE,
     CULL_BACKFACE
 };
 
+enum clip_method {
+    CLIP_FRUSTUM,   // clip against all six frustum planes
+    CLIP_GUARD_BAND // clip against near, far and the guard band only
+};
+
+enum pipeline_method {
+    PIPELINE_CAMERA_SPACE, // clip in camera space, then project
+    PIPELINE_CLIP_SPACE    // multiply by the combined MVP, clip in homogeneous space
+};
+
+enum raster_method {
+    RASTER_EDGE,    // incremental edge functions over the bounding box
+    RASTER_SCANLINE // flat-top/flat-bottom scanlines
+};
+
 enum render_method {
     RENDER_WIRE,
     RENDER_WIRE_VERTEX,
@@ -25,11 +40,17 @@ enum render_method {
     RENDER_TEXTURED_WIRE
 };
 
+// frame sink: receives the finished color buffer (RGBA32) once per rendered frame
+typedef void (*frame_sink_t)(const color_t* color_buffer, int width, int height, void* user_data);
+
 // pipeline
 bool initialize(void);
 void render(void);
 void update(void);
+void update_async(void);
+void update_wait(void);
 bool setup(void);
+void setup_pipeline(void);
 
 // getter and setters
 int get_window_width(void);
@@ -39,8 +60,22 @@ color_t* get_color_buffer(void);
 float* get_z_buffer(void);
 float get_delta_time(void);
 void set_export(bool isExport);
+void set_capture_policy(int policy);
+void set_capture_format(int format);
+void set_capture_stream(int format, const char* path);
 void set_render_method(int render_method);
 void set_cull_method(int cull_method);
+void set_clip_method(int clip_method);
+void set_pipeline_method(int pipeline_method);
+void set_raster_method(int raster_method);
+void set_fixed_delta_time(float seconds);
+void set_headless(bool isHeadless);
+bool get_headless(void);
+void set_resolution(int width, int height);
+void set_num_threads(int num_threads);
+int get_num_threads(void);
+void set_frame_sink(frame_sink_t sink, void* user_data);
+void capture_frame_sink(const color_t* pixels, int width, int height, void* user_data);
 
 // save
 void flip_pixels_vertically(Uint8* pixels, int width, int height, int pitch);
@@ -49,7 +84,6 @@ void flip_pixels_vertically(Uint8* pixels, int width, int height, int pitch);
 void clear_color_buffer(color_t color);
 void clear_z_buffer(void);
 void destroy_display(void);
-void destroy_save(void);
 
 // render options
 bool is_render_texture(void);
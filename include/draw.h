@@ -6,6 +6,11 @@
 #include "texture.h"
 #include "upng.h"
 
+// Pixel rectangle with inclusive bounds, e.g. the screen tile a thread draws to
+typedef struct {
+    int x_min, y_min, x_max, y_max;
+} rect_t;
+
 void draw_pixel(int x, int y, color_t color, int window_width, int window_height, color_t* color_buffer);
 void draw_texel(int x, int y,
                 vec4_t point_a, vec4_t point_b, vec4_t point_c,
@@ -14,8 +19,11 @@ void draw_texel(int x, int y,
                 int window_width, int window_height,
                 color_t* color_buffer, float* z_buffer);
 void draw_line(int x0, int y0, int x1, int y1, color_t color, int window_width, int window_height, color_t* color_buffer);
+void draw_line_clipped(int x0, int y0, int x1, int y1, color_t color, const rect_t* clip, int window_width, color_t* color_buffer);
 void draw_grid(color_t color, int window_width, int window_height, color_t* color_buffer);
 void draw_rectangle(int x, int y, int w, int h, color_t color, int window_width, int window_height, color_t* color_buffer);
+void draw_rectangle_clipped(int x, int y, int w, int h, color_t color, const rect_t* clip,
+                            int window_width, int window_height, color_t* color_buffer);
 
 
 #endif // DRAW_H
@@ -0,0 +1,152 @@
+#ifndef EDGE_H
+#define EDGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Fixed-point edge functions, shared by the renderer (src) and the mini
+// rasterizer (src-tr). Header only, and independent of either vector type.
+///////////////////////////////////////////////////////////////////////////////
+// Vertices are snapped to 28.4 fixed point (1/16 pixel). The edge function
+// E(p) = (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x) of two snapped
+// vertices and a pixel center is then an exact integer in 1/256 pixel^2, so
+// the top-left rule is an exact compare and shared edges never leave gaps or
+// draw twice: the edges are watertight.
+//
+// Edge values are 64 bit. edge_fits_int32() tells when a triangle is small
+// enough that every value fits 32 bit, e.g. for 8 lanes of int32 SIMD.
+///////////////////////////////////////////////////////////////////////////////
+
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_ONE (1 << SUBPIXEL_BITS)
+#define SUBPIXEL_HALF (SUBPIXEL_ONE / 2)
+
+typedef struct {
+    int64_t value; // at the center of the first pixel, inside when >= 0
+    int64_t dx;    // step to the next pixel in x
+    int64_t dy;    // step to the next row
+    int64_t bias;  // 0 on top-left edges, -1 on others, included in value
+} edge_fn_t;
+
+typedef struct {
+    int x_min, y_min, x_max, y_max; // bounding box in pixels, clamped to the viewport
+    int x_origin, y_origin;         // pixel the edge values are evaluated at
+    edge_fn_t edges[3];             // edge i is opposite of vertex i
+    int64_t area;                   // twice the triangle area, > 0
+    int order[3];                   // vertex order with a positive area
+    int32_t extent;                 // largest bounding box side in 28.4
+} edge_setup_t;
+
+/**
+ * @brief snaps a pixel coordinate to 28.4 fixed point, rounding to nearest.
+ */
+static inline int32_t edge_snap(float v){
+    return (int32_t)lrintf(v * SUBPIXEL_ONE);
+}
+
+/**
+ * @brief returns if the edge is top or left based on top-left rule:
+ *        a pixel center exactly on a flat top edge or a left edge belongs to
+ *        the triangle, on any other edge it doesn't (y points down).
+ */
+static inline bool edge_is_top_left(int32_t ax, int32_t ay, int32_t bx, int32_t by){
+    bool is_top_edge = by == ay && bx > ax;
+    bool is_left_edge = by < ay;
+    return is_top_edge || is_left_edge;
+}
+
+/**
+ * @brief sets up the three edge functions of a triangle with 28.4 vertices,
+ *        evaluated at the center of the top left pixel of its bounding box,
+ *        the origin.
+ *
+ * @param x, y: vertices in 28.4 fixed point
+ *        width, height: viewport the bounding box is clamped to
+ *        setup: returns the setup
+ * @return returns false, when the triangle is degenerate or off-screen.
+ */
+static inline bool edge_setup_triangle(const int32_t x[3], const int32_t y[3], int width, int height, edge_setup_t* setup){
+    int64_t area = (int64_t)(x[1] - x[0]) * (y[2] - y[0]) - (int64_t)(y[1] - y[0]) * (x[2] - x[0]);
+    if (area == 0){
+        return false;
+    }
+
+    // Edge functions are positive inside of triangles with a positive area,
+    // flip the others (back faces when culling is off).
+    setup->order[0] = 0;
+    setup->order[1] = area > 0 ? 1 : 2;
+    setup->order[2] = area > 0 ? 2 : 1;
+    setup->area = area > 0 ? area : -area;
+
+    int32_t vx[3], vy[3];
+    for (int i = 0; i < 3; i++){
+        vx[i] = x[setup->order[i]];
+        vy[i] = y[setup->order[i]];
+    }
+
+    int32_t x_min = vx[0], x_max = vx[0], y_min = vy[0], y_max = vy[0];
+    for (int i = 1; i < 3; i++){
+        if (vx[i] < x_min) x_min = vx[i];
+        if (vx[i] > x_max) x_max = vx[i];
+        if (vy[i] < y_min) y_min = vy[i];
+        if (vy[i] > y_max) y_max = vy[i];
+    }
+    setup->extent = (x_max - x_min) > (y_max - y_min) ? (x_max - x_min) : (y_max - y_min);
+
+    // Pixels whose centers can be covered, clamped to the viewport
+    setup->x_min = (x_min - SUBPIXEL_HALF + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS;
+    setup->y_min = (y_min - SUBPIXEL_HALF + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS;
+    setup->x_max = (x_max - SUBPIXEL_HALF) >> SUBPIXEL_BITS;
+    setup->y_max = (y_max - SUBPIXEL_HALF) >> SUBPIXEL_BITS;
+    if (setup->x_min < 0) setup->x_min = 0;
+    if (setup->y_min < 0) setup->y_min = 0;
+    if (setup->x_max > width - 1) setup->x_max = width - 1;
+    if (setup->y_max > height - 1) setup->y_max = height - 1;
+    if (setup->x_min > setup->x_max || setup->y_min > setup->y_max){
+        return false;
+    }
+
+    setup->x_origin = setup->x_min;
+    setup->y_origin = setup->y_min;
+    int64_t px = ((int64_t)setup->x_origin << SUBPIXEL_BITS) + SUBPIXEL_HALF;
+    int64_t py = ((int64_t)setup->y_origin << SUBPIXEL_BITS) + SUBPIXEL_HALF;
+    for (int i = 0; i < 3; i++){
+        int a = (i + 1) % 3;
+        int b = (i + 2) % 3;
+        edge_fn_t* e = &setup->edges[i];
+        e->bias = edge_is_top_left(vx[a], vy[a], vx[b], vy[b]) ? 0 : -1;
+        e->value = (int64_t)(vx[b] - vx[a]) * (py - vy[a]) - (int64_t)(vy[b] - vy[a]) * (px - vx[a]) + e->bias;
+        e->dx = (int64_t)(vy[a] - vy[b]) * SUBPIXEL_ONE;
+        e->dy = (int64_t)(vx[b] - vx[a]) * SUBPIXEL_ONE;
+    }
+    return true;
+}
+
+/**
+ * @brief cuts the bounding box down to a scissor rectangle, e.g. a screen
+ *        tile. The origin stays, so a triangle drawn in several tiles gets
+ *        exactly the same edge values and attributes in all of them.
+ *
+ * @param x_min, y_min, x_max, y_max: scissor rectangle, inclusive
+ * @return returns false, when the triangle is outside of the rectangle.
+ */
+static inline bool edge_setup_scissor(edge_setup_t* setup, int x_min, int y_min, int x_max, int y_max){
+    if (setup->x_min < x_min) setup->x_min = x_min;
+    if (setup->y_min < y_min) setup->y_min = y_min;
+    if (setup->x_max > x_max) setup->x_max = x_max;
+    if (setup->y_max > y_max) setup->y_max = y_max;
+    return setup->x_min <= setup->x_max && setup->y_min <= setup->y_max;
+}
+
+/**
+ * @brief returns true, when every edge value of the bounding box fits 32 bit:
+ *        the pixel centers lie within the triangle's extent, so each product
+ *        of E(p) stays below 2^30 for extents below 2^15 (2048 pixels).
+ */
+static inline bool edge_fits_int32(const edge_setup_t* setup){
+    return setup->extent < (1 << 15);
+}
+
+#endif // EDGE_H
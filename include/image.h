@@ -0,0 +1,27 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Image files for captured frames, from RGBA pixels (byte order R, G, B, A).
+///////////////////////////////////////////////////////////////////////////////
+// PNG goes through SDL_image (zlib, slow). QOI (https://qoiformat.org) is
+// lossless too, in one pass without entropy coding, and PPM is uncompressed
+// RGB, e.g. as a baseline.
+///////////////////////////////////////////////////////////////////////////////
+
+enum image_format {
+    IMAGE_PNG,
+    IMAGE_QOI,
+    IMAGE_PPM
+};
+
+bool image_write(const char* path, int format, const uint8_t* rgba, int width, int height, int pitch);
+size_t qoi_max_size(int width, int height);
+size_t qoi_encode(const uint8_t* rgba, int width, int height, int pitch, uint8_t* out);
+const char* image_format_extension(int format);
+
+#endif // IMAGE_H
@@ -0,0 +1,37 @@
+#ifndef JOB_H
+#define JOB_H
+
+#include <stdbool.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Work-stealing job scheduler for the frame tasks (geometry chunks, screen
+// tiles, buffer clears, exports). A job is a function called with an index.
+///////////////////////////////////////////////////////////////////////////////
+// Every worker owns a deque: it pushes and pops the jobs it submits itself at
+// the back, and steals from the front of the others when it runs dry. Jobs
+// submitted by other threads (the main thread) go to a global injection
+// queue. A counter tracks unfinished jobs: job_wait() runs jobs until it
+// drops to zero, and jobs submitted with a dependency only start then.
+///////////////////////////////////////////////////////////////////////////////
+
+typedef void (*job_func_t)(void* data, int index);
+
+typedef struct job_waiting job_waiting_t;
+
+// Zero-initialize, e.g. job_counter_t counter = { 0 };
+typedef struct {
+    int pending;            // submitted jobs that didn't finish yet
+    job_waiting_t* waiting; // jobs that start when pending drops to zero
+} job_counter_t;
+
+bool job_init(int num_threads);
+void job_shutdown(void);
+int job_num_threads(void);
+int job_thread_index(void);
+bool job_is_worker_thread(void);
+void job_submit(job_func_t func, void* data, int count, int stage,
+                job_counter_t* dependency, job_counter_t* counter);
+void job_wait(job_counter_t* counter);
+void job_parallel_for(job_func_t func, void* data, int count, int stage);
+
+#endif // JOB_H
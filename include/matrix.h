@@ -18,5 +18,6 @@ mat4_t mat4_mul_mat4(mat4_t a, mat4_t b);
 mat4_t mat4_make_perspective(float fov, float aspect, float znear, float zfar);
 vec4_t mat4_mul_vec4_project(mat4_t mat_proj, vec4_t v);
 mat4_t mat4_look_at(vec3_t eye, vec3_t target, vec3_t up);
+void mat4_mul_vec4_batch(const mat4_t* m, const vec4_soa_t* in, vec4_soa_t* out, int count);
 
 #endif // MATRIX_H
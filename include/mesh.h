@@ -2,7 +2,9 @@
 #define MESH_H
 
 #include "vector.h"
+#include "matrix.h"
 #include "triangle.h"
+#include "clip.h"
 #include <stdbool.h>
 #include "upng.h"
 
@@ -11,10 +13,25 @@
 typedef struct{
     vec3_t* vertices;   // mesh dynamic array of vertices
     face_t* faces;      // mesh dynamic array of faces
+    tex2_t* texcoords;  // mesh dynamic array of texture coordinates, indexed by faces
+    vec4_soa_t positions;       // structure-of-arrays copy of the vertices
+    vec4_soa_t camera_vertices; // camera-space vertex cache, one per vertex
+    vec4_soa_t clip_vertices;   // clip-space vertex cache of the homogeneous pipeline
+    outcode_t* outcodes;        // frustum outcodes of the cached vertices, one per vertex
     upng_t* texture;    // mesh PNG texture pointer
+    int material;       // index of the texture in the texture registry
     vec3_t rotation;    // mesh rotation with x, y, and z values
     vec3_t scale;       // mesh scale with x, y, and z values
     vec3_t translation; // mesh translation with x, y, and z values
+    mat4_t world_mat;      // cached scale -> rotate -> translate matrix
+    mat4_t model_view_mat; // cached view * world matrix
+    mat4_t mvp_mat;        // cached proj * view * world matrix
+    int matrix_version;    // camera matrix version the cached matrices are built with
+    bool is_dirty;         // rotation, scale or translation changed since the last build
+    vec3_t aabb_min;        // object-space axis aligned bounding box
+    vec3_t aabb_max;
+    vec3_t bounding_center; // object-space bounding sphere
+    float bounding_radius;
 } mesh_t;
 
 bool load_mesh(char* obj_filename,
@@ -22,9 +39,23 @@ bool load_mesh(char* obj_filename,
                vec3_t scale,
                vec3_t translation,
                vec3_t rotation);
+bool load_mesh_data(vec3_t* vertices,
+                    face_t* faces,
+                    tex2_t* texcoords,
+                    upng_t* texture,
+                    vec3_t scale,
+                    vec3_t translation,
+                    vec3_t rotation);
 /* bool load_obj_file_data(char * filename); */
 bool load_mesh_obj_data(mesh_t* mesh, char * filename);
 bool load_mesh_png_data(mesh_t* mesh, char * filename);
+void mesh_set_rotation(mesh_t* mesh, vec3_t rotation);
+void mesh_set_scale(mesh_t* mesh, vec3_t scale);
+void mesh_set_translation(mesh_t* mesh, vec3_t translation);
+void mesh_update_matrices(mesh_t* mesh);
+void mesh_compute_bounds(mesh_t* mesh);
+int mesh_classify_frustum(mesh_t* mesh);
+int mesh_classify_clip_space(mesh_t* mesh);
 mesh_t* get_mesh(int index);
 void free_mesh(void);
 int get_num_meshes(void);
@@ -0,0 +1,80 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Frame profiler: scoped stage timers, per-frame counters and a Chrome trace.
+// Jobs of the scheduler (job.h) are timed per thread, on one trace row each.
+///////////////////////////////////////////////////////////////////////////////
+// Everything compiles out unless the build defines PROFILE (see `make profile`).
+// The trace can be opened in chrome://tracing or https://ui.perfetto.dev
+///////////////////////////////////////////////////////////////////////////////
+
+enum profiler_stage {
+    PROF_FRAME,          // one full update() + render()
+    PROF_UPDATE,         // update(): animation and geometry of all meshes
+    PROF_GEOMETRY,       // process_graphics_pipeline_stages(): all meshes, all threads
+    PROF_TRANSFORM,      // world and view transform (accumulated per face)
+    PROF_CULL,           // back-face culling (accumulated per face)
+    PROF_CLIP,           // frustum clipping (accumulated per face)
+    PROF_PROJECT,        // projection and screen mapping (accumulated per face)
+    PROF_RENDER,         // render(): clear, raster, upload and export
+    PROF_CLEAR_COLOR,    // color buffer clear jobs (job time only)
+    PROF_CLEAR_Z,        // z-buffer clear jobs (job time only)
+    PROF_BIN,            // binning the triangles to screen tiles
+    PROF_RASTER,         // the triangle loop in render(), all tiles
+    PROF_TEXTURE_UPLOAD, // SDL_UpdateTexture()
+    PROF_EXPORT,         // downscaling a captured frame into the capture ring
+    PROF_NUM_STAGES
+};
+
+enum profiler_counter {
+    PROF_FACES_IN,
+    PROF_FACES_CULLED,
+    PROF_FACES_CLIPPED,  // faces that were clipped away completely
+    PROF_TRIANGLES_EMITTED,
+    PROF_PIXELS_TESTED,
+    PROF_PIXELS_WRITTEN,
+    PROF_MESHES_CULLED,    // meshes whose bounding volume is outside of the frustum
+    PROF_MESHES_UNCLIPPED, // meshes whose bounding volume is inside of the frustum
+    PROF_FACES_ACCEPTED,   // faces inside of the frustum, not clipped
+    PROF_FACES_REJECTED,   // faces outside of one frustum plane, discarded by outcode
+    PROF_FACES_STRADDLING, // faces that went through polygon clipping
+    PROF_BLOCKS_SKIPPED,   // 8x8 raster blocks outside of the triangle
+    PROF_BLOCKS_PARTIAL,   // 8x8 raster blocks tested per pixel
+    PROF_BLOCKS_COVERED,   // 8x8 raster blocks drawn without edge tests (scalar only)
+    PROF_JOBS_RUN,         // jobs run by the scheduler, on all threads
+    PROF_JOBS_STOLEN,      // jobs a worker took from another worker's deque
+    PROF_NUM_COUNTERS
+};
+
+#ifdef PROFILE
+#define PROFILE_BEGIN(stage) profiler_begin(stage)
+#define PROFILE_END(stage) profiler_end(stage)
+#define PROFILE_COUNT(counter, n) profiler_count(counter, n)
+#define PROFILE_JOB_BEGIN(stage) profiler_job_begin(stage)
+#define PROFILE_JOB_END(stage) profiler_job_end(stage)
+#define PROFILE_FRAME_END() profiler_frame_end()
+#define PROFILE_WRITE_TRACE(path) profiler_write_trace(path)
+#else
+#define PROFILE_BEGIN(stage) do {} while (0)
+#define PROFILE_END(stage) do {} while (0)
+#define PROFILE_COUNT(counter, n) do {} while (0)
+#define PROFILE_JOB_BEGIN(stage) do {} while (0)
+#define PROFILE_JOB_END(stage) do {} while (0)
+#define PROFILE_FRAME_END() do {} while (0)
+#define PROFILE_WRITE_TRACE(path) do {} while (0)
+#endif
+
+void profiler_begin(int stage);
+void profiler_end(int stage);
+void profiler_count(int counter, int n);
+void profiler_job_begin(int stage);
+void profiler_job_end(int stage);
+void profiler_frame_end(void);
+uint64_t profiler_get_total(int counter);
+bool profiler_write_trace(const char* path);
+
+#endif // PROFILER_H
@@ -0,0 +1,29 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "capture.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Streaming video output: captured frames appended to one file or pipe as
+// they are produced, for encoders like ffmpeg to read without PNG files.
+///////////////////////////////////////////////////////////////////////////////
+// Y4M (YUV4MPEG2) carries its own header: 4:2:0, BT.601 limited range.
+// Raw RGBA has none, e.g. ffmpeg -f rawvideo -pixel_format rgba
+// -video_size WxH -framerate FPS -i -
+// Frames must arrive in order, i.e. from a single capture encoder.
+///////////////////////////////////////////////////////////////////////////////
+
+enum stream_format {
+    STREAM_Y4M,
+    STREAM_RGBA
+};
+
+bool stream_open(const char* path, int format, int width, int height, int fps);
+bool stream_write_frame(const capture_frame_t* frame, void* user_data);
+void stream_close(void);
+void rgba_to_yuv420(const capture_frame_t* frame, uint8_t* y_plane, uint8_t* u_plane, uint8_t* v_plane);
+const char* stream_format_name(int format);
+
+#endif // STREAM_H
@@ -1,11 +1,55 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <math.h>
+#include <stdint.h>
+#include "upng.h"
+
+// Texture registry: screen triangles refer to their texture by a small index
+// (material) instead of a pointer. Index 0 up to MAX_TEXTURES - 1.
+#define MAX_TEXTURES 65536
+
 typedef struct {
     float u;
     float v;
 } tex2_t;
 
+// Texture coordinates of screen triangles, packed into 4.12 signed fixed
+// point: -8 up to 8 in steps of 1/4096. Not unorm, as the sampler wraps, so
+// texture coordinates may leave 0..1.
+#define TEX2_FRACTION_BITS 12
+#define TEX2_ONE (1 << TEX2_FRACTION_BITS)
+
+typedef struct {
+    int16_t u;
+    int16_t v;
+} tex2_packed_t;
+
 tex2_t tex2_clone(tex2_t* t);
 
+/**
+ * @brief packs texture coordinates to 4.12 fixed point, rounded to the
+ *        nearest step and clamped to the range.
+ */
+static inline int16_t tex2_pack_component(float c){
+    long value = lrintf(c * TEX2_ONE);
+    if (value < INT16_MIN) value = INT16_MIN;
+    if (value > INT16_MAX) value = INT16_MAX;
+    return (int16_t)value;
+}
+
+static inline tex2_packed_t tex2_pack(tex2_t t){
+    tex2_packed_t packed = { tex2_pack_component(t.u), tex2_pack_component(t.v) };
+    return packed;
+}
+
+static inline tex2_t tex2_unpack(tex2_packed_t t){
+    tex2_t unpacked = { (float)t.u / TEX2_ONE, (float)t.v / TEX2_ONE };
+    return unpacked;
+}
+
+int texture_register(upng_t* texture);
+upng_t* texture_get(int material);
+void texture_clear_registry(void);
+
 #endif // TEXTURE_H
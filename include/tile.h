@@ -0,0 +1,28 @@
+#ifndef TILE_H
+#define TILE_H
+
+#include <stdbool.h>
+#include "draw.h"
+#include "triangle.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Screen tiles for binned rasterization. Every frame the triangle stream is
+// sorted into the tiles it overlaps, in stream order, so each tile can be
+// rasterized on its own thread into its own slice of the color and z-buffer,
+// with exactly the pixels a serial pass would write.
+///////////////////////////////////////////////////////////////////////////////
+
+#define TILE_SIZE 64
+
+typedef struct {
+    rect_t rect;    // pixels of the tile
+    int* triangles; // dynamic array of indices into the triangle stream
+} tile_t;
+
+bool init_tiles(int window_width, int window_height);
+void bin_triangles_to_tiles(const screen_triangle_t* triangles, int num_triangles);
+int get_num_tiles(void);
+const tile_t* get_tile(int index);
+void free_tiles(void);
+
+#endif // TILE_H
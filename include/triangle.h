@@ -2,34 +2,48 @@
 #define TRIANGLE_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "vector.h"
 #include "texture.h"
 #include "color.h"
 #include "upng.h"
-
-#define MAX_TRIANGLES_PER_MESH 10000
+#include "edge.h"
+#include "draw.h"
 
 typedef struct {
     int a; // vertex numbers
     int b;
     int c;
-    tex2_t a_uv; // texture uv coordinates
-    tex2_t b_uv;
-    tex2_t c_uv;
+    int a_uv; // texture coordinate numbers, see mesh_t texcoords
+    int b_uv;
+    int c_uv;
     color_t color;
 } face_t;
 
 typedef struct {
     vec4_t points[3];
     tex2_t textcoords[3];
-    color_t color;
-    upng_t* texture;
-} triangle_t; // triangle for rendering
+} triangle_t; // triangle after clipping
+
+// Compact screen-space triangle, written by the geometry stage into one
+// contiguous stream and read by pointer by the rasterizer.
+typedef struct {
+    int32_t x[3];      // 28.4 fixed-point screen coordinates, see edge_snap()
+    int32_t y[3];
+    float inv_w[3];    // 1/w, for the depth test and perspective correction
+    tex2_packed_t uv[3]; // see tex2_pack()
+    color_t color;     // flat shaded color
+    uint16_t material; // texture, see texture_get()
+} screen_triangle_t;
 
-void update_triangles_to_render(int i, triangle_t triangle);
-triangle_t get_triangle_to_render(int i);
-void set_num_triangles_to_render(int num);
+void push_triangle_to_render(const screen_triangle_t* triangle);
+void append_triangles_to_render(const screen_triangle_t* triangles, int count);
+void clear_triangles_to_render(void);
+void swap_triangles_to_render(void);
+const screen_triangle_t* get_triangles_to_render(void);
 int get_num_triangles_to_render(void);
+int get_triangles_high_water_mark(void);
+void free_triangles_to_render(void);
 vec3_t get_triangle_normal(vec4_t vertices[3]);
 
 void draw_triangle_pixel(int x, int y,
@@ -42,6 +56,11 @@ void draw_triangle(int x0, int y0,
                    int x2, int y2,
                    color_t color,
                    int window_width, int window_height, color_t* color_buffer);
+void draw_triangle_clipped(int x0, int y0,
+                           int x1, int y1,
+                           int x2, int y2,
+                           color_t color, const rect_t* clip,
+                           int window_width, int window_height, color_t* color_buffer);
 void draw_filled_triangle(int x0, int y0, float z0, float w0,
                           int x1, int y1, float z1, float w1,
                           int x2, int y2, float z2, float w2,
@@ -52,6 +71,12 @@ void draw_textured_triangle(int x0, int y0, float z0, float w0, tex2_t uv_a,
                             int x1, int y1, float z1, float w1, tex2_t uv_b,
                             int x2, int y2, float z2, float w2, tex2_t uv_c,
                             upng_t* texture, int window_width, int window_height, color_t* color_buffer, float* z_buffer);
+void draw_filled_triangle_edge(const screen_triangle_t* triangle, const rect_t* scissor,
+                               int window_width, int window_height,
+                               color_t* color_buffer, float* z_buffer);
+void draw_textured_triangle_edge(const screen_triangle_t* triangle, upng_t* texture, const rect_t* scissor,
+                                 int window_width, int window_height,
+                                 color_t* color_buffer, float* z_buffer);
 void fill_flat_bottom_triangle(int x0, int y0,
                                int x1, int y1,
                                int x2, int y2,
@@ -1,6 +1,8 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
+#include <stdbool.h>
+
 typedef struct{
     float x;
     float y;
@@ -16,6 +18,17 @@ typedef struct{
     float x, y, z, w;
 } vec4_t;
 
+// Structure-of-arrays storage of a vertex stream, for the SIMD batch kernels.
+// Every array is 32-byte aligned and padded to a multiple of SOA_WIDTH floats.
+#define SOA_WIDTH 8
+typedef struct{
+    float* x;
+    float* y;
+    float* z;
+    float* w; // NULL, when the stream has no w component
+    int count;
+} vec4_soa_t;
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////
 // 2D Vector functions
@@ -46,6 +59,13 @@ vec3_t vec3_rotate_x(vec3_t v, float angle);
 vec3_t vec3_rotate_y(vec3_t v, float angle);
 vec3_t vec3_rotate_z(vec3_t v, float angle);
 
+///////////////////////////////////////////////////////////////////////////////////////////
+// Structure-of-arrays functions
+///////////////////////////////////////////////////////////////////////////////////////////
+int soa_padded_count(int count);
+bool vec4_soa_alloc(vec4_soa_t* soa, int count, bool with_w);
+void vec4_soa_free(vec4_soa_t* soa);
+
 ///////////////////////////////////////////////////////////////////////////////////////////
 // Vector conversion functions
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -3,9 +3,7 @@
 #include <SDL2/SDL.h>
 #include "display.h"
 #include "vec2.h"
-
-#define MIN(a, b) (((a) < (b)) ? (a) : (b))
-#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#include "edge.h"
 
 bool is_running = false;
 
@@ -45,83 +43,49 @@ void process_input(void) {
 }
 
 /**
- * @brief returns if the edge is top or left based on top-left rule
- * top-left rule:
- * a pixel center is defined to lie inside of a trinagle
- * if it lies on a flat top edge or a left edge of a triangle.
- *
- * @param
- * @return
- */
-bool is_top_left(vec2_t* start, vec2_t* end) {
-  vec2_t edge = { end->x - start->x, end->y - start->y };
-  bool is_top_edge = edge.y == 0 && edge.x > 0;
-  bool is_left_edge = edge.y < 0;
-  return is_top_edge || is_left_edge;
-}
-
-/**
- * @brief returns "2D cross product"
+ * @brief fills a triangle with interpolated vertex colors. The vertices are
+ *        snapped to 28.4 fixed point and tested with the integer edge
+ *        functions of edge.h, so the top-left rule is exact and the two
+ *        triangles sharing an edge neither overlap nor leave a gap.
  *
- * @param
+ * @param v0, v1, v2: vertices in pixels
  * @return
  */
-float edge_cross(vec2_t* a, vec2_t* b, vec2_t* p){
-  vec2_t ab = {b->x - a->x, b->y - a->y};
-  vec2_t ap = {p->x - a->x, p->y - a->y};
-  return ab.x*ap.y  - ab.y*ap.x;
-}
-
 void triangle_fill(vec2_t v0, vec2_t v1, vec2_t v2) {
+  int32_t x[3] = { edge_snap(v0.x), edge_snap(v1.x), edge_snap(v2.x) };
+  int32_t y[3] = { edge_snap(v0.y), edge_snap(v1.y), edge_snap(v2.y) };
 
-  // Compute the area of the entire triangle/parallelogram
-  float area = edge_cross(&v0, &v1, &v2);
-
-  // Finds the bounding box with all candidate pixels
-  int x_min = floor(MIN(MIN(v0.x, v1.x), v2.x));
-  int y_min = floor(MIN(MIN(v0.y, v1.y), v2.y));
-  int x_max = ceil(MAX(MAX(v0.x, v1.x), v2.x));
-  int y_max = ceil(MAX(MAX(v0.y, v1.y), v2.y));
-
-  // Compute the constant delta_s that will be used for the horizontal and vertical steps
-  float delta_w0_col = (v0.y - v1.y); // delta x
-  float delta_w1_col = (v1.y - v2.y);
-  float delta_w2_col = (v2.y - v0.y);
-
-  float delta_w0_row = (v1.x - v0.x); // delta y
-  float delta_w1_row = (v2.x - v1.x);
-  float delta_w2_row = (v0.x - v2.x);
-
-  float bias0 = is_top_left(&v0, &v1) ? 0 : -0.0001; // push into negative domain.
-  float bias1 = is_top_left(&v1, &v2) ? 0 : -0.0001; // fixed point format could be an option.
-  float bias2 = is_top_left(&v2, &v0) ? 0 : -0.0001;
-
-  // Note that edge_cross will help know whether the point is
-  // on the right side of the input vector, but also
-  // how far the point from the input vector.
-  // push into negative domain with bias -> keep edge drawings exclusive && no
-  // overlap
-  vec2_t p = {x_min + 0.5f, y_min + 0.5f}; // The point that gets tested against the edge is the middle of the pixel.
-  float w0_row = edge_cross(&v0, &v1, &p) + bias0; // right side of edge && top left?
-  float w1_row = edge_cross(&v1, &v2, &p) + bias1;
-  float w2_row = edge_cross(&v2, &v0, &p) + bias2;
+  edge_setup_t setup;
+  if (!edge_setup_triangle(x, y, SCREEN_WIDTH, SCREEN_HEIGHT, &setup)) {
+    return;
+  }
+  const edge_fn_t* e = setup.edges;
+  float inv_area = 1.0f / setup.area;
 
   // Loop all candidate pixels inside the bounding box
-  for (int y = y_min; y <= y_max; y++) {
-    float w0 = w0_row;
-    float w1 = w1_row;
-    float w2 = w2_row;
-    for (int x = x_min; x <= x_max; x++) {
-      bool is_inside = w0 >= 0 && w1 >= 0 && w2 >= 0;
+  int64_t w0_row = e[0].value;
+  int64_t w1_row = e[1].value;
+  int64_t w2_row = e[2].value;
+  for (int y = setup.y_min; y <= setup.y_max; y++) {
+    int64_t w0 = w0_row;
+    int64_t w1 = w1_row;
+    int64_t w2 = w2_row;
+    for (int x = setup.x_min; x <= setup.x_max; x++) {
+      // the top-left bias is folded into the edge values: >= 0 is inside
+      bool is_inside = (w0 | w1 | w2) >= 0;
       if (is_inside) {
-        float alpha = w0 / area;
-        float beta  = w1 / area;
-        float gamma = w2 / area;
+        // barycentric weights without the bias, edge i is opposite of vertex i
+        float alpha = (w0 - e[0].bias) * inv_area;
+        float beta  = (w1 - e[1].bias) * inv_area;
+        float gamma = (w2 - e[2].bias) * inv_area;
+        const color_t* c0 = &colors[setup.order[0]];
+        const color_t* c1 = &colors[setup.order[1]];
+        const color_t* c2 = &colors[setup.order[2]];
 
         int a = 0xFF;
-        int r = (alpha)*colors[0].r + (beta)*colors[1].r + (gamma)*colors[2].r;
-        int g = (alpha)*colors[0].g + (beta)*colors[1].g + (gamma)*colors[2].g;
-        int b = (alpha)*colors[0].b + (beta)*colors[1].b + (gamma)*colors[2].b;
+        int r = (alpha)*c0->r + (beta)*c1->r + (gamma)*c2->r;
+        int g = (alpha)*c0->g + (beta)*c1->g + (gamma)*c2->g;
+        int b = (alpha)*c0->b + (beta)*c1->b + (gamma)*c2->b;
 
         uint32_t interp_color = 0x00000000;
         interp_color = (interp_color | a) << 8;
@@ -130,13 +94,13 @@ void triangle_fill(vec2_t v0, vec2_t v1, vec2_t v2) {
         interp_color = (interp_color | r);
         draw_pixel(x, y, interp_color);
       }
-      w0 += delta_w0_col;
-      w1 += delta_w1_col;
-      w2 += delta_w2_col;
+      w0 += e[0].dx;
+      w1 += e[1].dx;
+      w2 += e[2].dx;
     }
-    w0_row += delta_w0_row;
-    w1_row += delta_w1_row;
-    w2_row += delta_w2_row;
+    w0_row += e[0].dy;
+    w1_row += e[1].dy;
+    w2_row += e[2].dy;
   }
 }
 
@@ -7,7 +7,7 @@
 
 void* array_hold(void* array, int count, int item_size) {
     if (array == NULL) {
-        int raw_size = (sizeof(int) * 2) + (item_size * count);
+        size_t raw_size = (sizeof(int) * 2) + ((size_t)item_size * count);
         int* base = (int*)malloc(raw_size);
         base[0] = count;  // capacity
         base[1] = count;  // occupied
@@ -20,7 +20,7 @@ void* array_hold(void* array, int count, int item_size) {
         int double_curr = ARRAY_CAPACITY(array) * 2;
         int capacity = needed_size > double_curr ? needed_size : double_curr;
         int occupied = needed_size;
-        int raw_size = sizeof(int) * 2 + item_size * capacity;
+        size_t raw_size = sizeof(int) * 2 + (size_t)item_size * capacity;
         int* base = (int*)realloc(ARRAY_RAW_DATA(array), raw_size);
         base[0] = capacity;
         base[1] = occupied;
@@ -32,6 +32,13 @@ int array_length(void* array) {
     return (array != NULL) ? ARRAY_OCCUPIED(array) : 0;
 }
 
+// Empties the array but keeps its capacity, so it can be refilled without reallocation
+void array_clear(void* array) {
+    if (array != NULL) {
+        ARRAY_OCCUPIED(array) = 0;
+    }
+}
+
 void array_free(void* array) {
     if (array != NULL) {
         free(ARRAY_RAW_DATA(array));
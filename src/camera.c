@@ -1,3 +1,4 @@
+#include <string.h>
 #include "camera.h"
 #include "matrix.h"
 
@@ -13,6 +14,7 @@ static float zfar;
 static mat4_t proj_mat; // projection matrix
 static mat4_t view_mat; // look_at matrix
 static mat4_t world_mat;
+static int matrix_version = 0; // bumped whenever view_mat or proj_mat changes
 
 static camera_t camera = {
     .position = {0, 0, 0},
@@ -45,7 +47,13 @@ void set_target(vec3_t* target){
 }
 
 void set_view_mat(vec3_t target, vec3_t up_direction){
-    view_mat = mat4_look_at(camera.position, target, up_direction);
+    mat4_t mat = mat4_look_at(camera.position, target, up_direction);
+
+    // Only a changed camera invalidates the cached model-view matrices of the meshes.
+    if (memcmp(&mat, &view_mat, sizeof(mat4_t)) != 0){
+        view_mat = mat;
+        matrix_version++;
+    }
 }
 
 void set_camera_position(vec3_t pos){
@@ -85,6 +93,7 @@ void set_camera_aspecty(float a){
 }
 void set_proj_mat(mat4_t mat){
     proj_mat = mat;
+    matrix_version++;
 }
 void set_world_mat(mat4_t mat){
     world_mat = mat;
@@ -158,6 +167,9 @@ mat4_t get_proj_mat(void){
 mat4_t get_view_mat(void){
     return view_mat;
 }
+int get_matrix_version(void){
+    return matrix_version;
+}
 mat4_t get_world_mat(void){
     return world_mat;
 }
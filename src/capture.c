@@ -0,0 +1,419 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime() and pthreads in -std=c99
+#include "capture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "array.h"
+#include "cpu.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CAPTURE_X86_SIMD
+#endif
+
+#define MAX_ENCODERS 16
+
+typedef struct capture_buffer {
+    capture_frame_t frame; // first, capture_submit() casts back
+    struct capture_buffer* next;
+} capture_buffer_t;
+
+static capture_buffer_t** buffers = NULL; // dynamic array, all buffers for freeing
+static capture_buffer_t* free_buffers = NULL; // stack
+static capture_buffer_t* queue_head = NULL;   // FIFO of submitted frames
+static capture_buffer_t* queue_tail = NULL;
+static int queue_depth = 0;
+static int num_encoding = 0;
+
+static int frame_width = 0;
+static int frame_height = 0;
+static int capture_policy = CAPTURE_BLOCK;
+static capture_writer_t frame_writer = NULL;
+static void* frame_writer_data = NULL;
+
+static pthread_t encoders[MAX_ENCODERS];
+static int num_encoders = 0;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t frame_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t buffer_freed = PTHREAD_COND_INITIALIZER;
+static bool is_shutdown = false;
+
+// Stats, under the mutex
+static capture_stats_t stats;
+static double queue_depth_sum = 0;
+static double encode_ms_sum = 0;
+
+static double now_ms(void){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+/**
+ * @brief allocates one more buffer in the frame size and puts it on the free
+ *        stack. Caller holds the mutex.
+ *
+ * @return returns false, when out of memory.
+ */
+static bool add_buffer(void){
+    capture_buffer_t* buffer = (capture_buffer_t*)malloc(sizeof(capture_buffer_t));
+    if (buffer == NULL){
+        return false;
+    }
+    buffer->frame.index = 0;
+    buffer->frame.width = frame_width;
+    buffer->frame.height = frame_height;
+    buffer->frame.pitch = frame_width * 4;
+    buffer->frame.pixels = (uint8_t*)malloc((size_t)buffer->frame.pitch * frame_height);
+    if (buffer->frame.pixels == NULL){
+        free(buffer);
+        return false;
+    }
+    array_push(buffers, buffer);
+    buffer->next = free_buffers;
+    free_buffers = buffer;
+    stats.num_buffers++;
+    return true;
+}
+
+static void* encoder_main(void* arg){
+    pthread_mutex_lock(&mutex);
+    for (;;){
+        while (queue_head == NULL && !is_shutdown){
+            pthread_cond_wait(&frame_queued, &mutex);
+        }
+        if (queue_head == NULL){
+            break; // shut down, and every frame is written
+        }
+        capture_buffer_t* buffer = queue_head;
+        queue_head = buffer->next;
+        if (queue_head == NULL){
+            queue_tail = NULL;
+        }
+        queue_depth--;
+        num_encoding++;
+        pthread_mutex_unlock(&mutex);
+
+        double start = now_ms();
+        bool is_written = frame_writer(&buffer->frame, frame_writer_data);
+        double encode_ms = now_ms() - start;
+
+        pthread_mutex_lock(&mutex);
+        num_encoding--;
+        if (is_written){
+            stats.frames_written++;
+        }else{
+            stats.frames_failed++;
+        }
+        encode_ms_sum += encode_ms;
+        if (encode_ms > stats.encode_ms_max){
+            stats.encode_ms_max = encode_ms;
+        }
+        buffer->next = free_buffers;
+        free_buffers = buffer;
+        pthread_cond_broadcast(&buffer_freed);
+    }
+    pthread_mutex_unlock(&mutex);
+    return NULL;
+}
+
+/**
+ * @brief allocates the buffers and starts the encoder threads.
+ *
+ * @param width, height: frame size in pixels
+ *        num_buffers: buffers in the ring, at least 1
+ *        num_encoders_requested: encoder threads, at least 1
+ *        policy: one of enum capture_policy, when every buffer is in use
+ *        writer: writes a frame, e.g. as PNG
+ *        user_data: passed to the writer
+ * @return returns false, when the buffers or threads could not be created.
+ */
+bool capture_init(int width, int height, int num_buffers, int num_encoders_requested, int policy,
+                  capture_writer_t writer, void* user_data){
+    capture_shutdown();
+
+    frame_width = width;
+    frame_height = height;
+    capture_policy = policy;
+    frame_writer = writer;
+    frame_writer_data = user_data;
+    capture_stats_t empty = { 0 };
+    stats = empty;
+    queue_depth_sum = 0;
+    encode_ms_sum = 0;
+
+    for (int i = 0; i < (num_buffers > 0 ? num_buffers : 1); i++){
+        if (!add_buffer()){
+            fprintf(stderr, "Failed to allocate the capture buffers.\n");
+            return false;
+        }
+    }
+
+    if (num_encoders_requested < 1){
+        num_encoders_requested = 1;
+    }
+    if (num_encoders_requested > MAX_ENCODERS){
+        num_encoders_requested = MAX_ENCODERS;
+    }
+    for (num_encoders = 0; num_encoders < num_encoders_requested; num_encoders++){
+        if (pthread_create(&encoders[num_encoders], NULL, encoder_main, NULL) != 0){
+            fprintf(stderr, "Failed to start capture encoder %d.\n", num_encoders);
+            return num_encoders > 0;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief hands out a free buffer to capture a frame into. With every buffer
+ *        in use, the policy waits, drops the frame, or grows the ring.
+ *
+ * @param
+ * @return returns the buffer, or NULL when the frame is dropped.
+ */
+capture_frame_t* capture_acquire(void){
+    pthread_mutex_lock(&mutex);
+    if (num_encoders == 0){
+        pthread_mutex_unlock(&mutex);
+        return NULL;
+    }
+    if (free_buffers == NULL){
+        if (capture_policy == CAPTURE_BLOCK){
+            double start = now_ms();
+            while (free_buffers == NULL){
+                pthread_cond_wait(&buffer_freed, &mutex);
+            }
+            stats.blocked_ms += now_ms() - start;
+        }else if (capture_policy == CAPTURE_GROW){
+            add_buffer();
+        }
+    }
+
+    capture_buffer_t* buffer = free_buffers;
+    if (buffer != NULL){
+        free_buffers = buffer->next;
+    }else{
+        stats.frames_dropped++;
+    }
+    pthread_mutex_unlock(&mutex);
+    return buffer != NULL ? &buffer->frame : NULL;
+}
+
+/**
+ * @brief queues a filled buffer of capture_acquire() for the encoders.
+ *
+ * @param frame
+ * @return
+ */
+void capture_submit(capture_frame_t* frame){
+    capture_buffer_t* buffer = (capture_buffer_t*)frame;
+    buffer->next = NULL;
+
+    pthread_mutex_lock(&mutex);
+    if (queue_tail != NULL){
+        queue_tail->next = buffer;
+    }else{
+        queue_head = buffer;
+    }
+    queue_tail = buffer;
+    queue_depth++;
+
+    stats.frames_submitted++;
+    queue_depth_sum += queue_depth;
+    if (queue_depth > stats.max_queue_depth){
+        stats.max_queue_depth = queue_depth;
+    }
+    pthread_cond_signal(&frame_queued);
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * @brief returns a buffer of capture_acquire() unused, e.g. when reading the
+ *        frame into it failed.
+ *
+ * @param frame
+ * @return
+ */
+void capture_release(capture_frame_t* frame){
+    capture_buffer_t* buffer = (capture_buffer_t*)frame;
+    pthread_mutex_lock(&mutex);
+    buffer->next = free_buffers;
+    free_buffers = buffer;
+    pthread_cond_broadcast(&buffer_freed);
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * @brief waits until every submitted frame is written.
+ *
+ * @param
+ * @return
+ */
+void capture_flush(void){
+    pthread_mutex_lock(&mutex);
+    while (queue_head != NULL || num_encoding > 0){
+        pthread_cond_wait(&buffer_freed, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * @brief writes the remaining frames, stops the encoders and frees the
+ *        buffers. The stats stay until the next capture_init().
+ *
+ * @param
+ * @return
+ */
+void capture_shutdown(void){
+    pthread_mutex_lock(&mutex);
+    is_shutdown = true;
+    pthread_cond_broadcast(&frame_queued);
+    pthread_mutex_unlock(&mutex);
+
+    for (int i = 0; i < num_encoders; i++){
+        pthread_join(encoders[i], NULL);
+    }
+    num_encoders = 0;
+    is_shutdown = false;
+
+    for (int i = 0; i < array_length(buffers); i++){
+        free(buffers[i]->frame.pixels);
+        free(buffers[i]);
+    }
+    array_free(buffers);
+    buffers = NULL;
+    free_buffers = NULL;
+    queue_head = queue_tail = NULL;
+    queue_depth = 0;
+}
+
+capture_stats_t capture_get_stats(void){
+    pthread_mutex_lock(&mutex);
+    capture_stats_t result = stats;
+    int num_encoded = stats.frames_written + stats.frames_failed;
+    result.mean_queue_depth = stats.frames_submitted > 0 ? queue_depth_sum / stats.frames_submitted : 0;
+    result.encode_ms_mean = num_encoded > 0 ? encode_ms_sum / num_encoded : 0;
+    pthread_mutex_unlock(&mutex);
+    return result;
+}
+
+/**
+ * @brief averages 2x2 pixels per channel, with rounding, for the pixels
+ *        [first, end) of one row. 2 channels per 32 bit lane at a time.
+ */
+static void downscale_row_scalar(const uint32_t* src0, const uint32_t* src1, uint32_t* dst, int first, int end){
+    const uint32_t mask = 0x00FF00FF;
+    for (int x = first; x < end; x++){
+        uint32_t a = src0[2 * x], b = src0[2 * x + 1];
+        uint32_t c = src1[2 * x], d = src1[2 * x + 1];
+        uint32_t even = (a & mask) + (b & mask) + (c & mask) + (d & mask) + 0x00020002;
+        uint32_t odd = ((a >> 8) & mask) + ((b >> 8) & mask) + ((c >> 8) & mask) + ((d >> 8) & mask) + 0x00020002;
+        dst[x] = ((even >> 2) & mask) | (((odd >> 2) & mask) << 8);
+    }
+}
+
+#ifdef CAPTURE_X86_SIMD
+__attribute__((target("sse4.1")))
+static int downscale_row_sse(const uint32_t* src0, const uint32_t* src1, uint32_t* dst, int width){
+    int x = 0;
+    __m128i zero = _mm_setzero_si128();
+    __m128i two = _mm_set1_epi16(2);
+    for (; x + 4 <= width; x += 4){
+        // 8 source pixels per row, split into even and odd columns
+        __m128 a0 = _mm_loadu_ps((const float*)(src0 + 2 * x));
+        __m128 b0 = _mm_loadu_ps((const float*)(src0 + 2 * x + 4));
+        __m128 a1 = _mm_loadu_ps((const float*)(src1 + 2 * x));
+        __m128 b1 = _mm_loadu_ps((const float*)(src1 + 2 * x + 4));
+        __m128i even0 = _mm_castps_si128(_mm_shuffle_ps(a0, b0, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i odd0 = _mm_castps_si128(_mm_shuffle_ps(a0, b0, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i even1 = _mm_castps_si128(_mm_shuffle_ps(a1, b1, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i odd1 = _mm_castps_si128(_mm_shuffle_ps(a1, b1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        // Sum the 4 pixels in 16 bit channels, round and divide by 4
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(even0, zero), _mm_unpacklo_epi8(odd0, zero));
+        lo = _mm_add_epi16(lo, _mm_add_epi16(_mm_unpacklo_epi8(even1, zero), _mm_unpacklo_epi8(odd1, zero)));
+        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(even0, zero), _mm_unpackhi_epi8(odd0, zero));
+        hi = _mm_add_epi16(hi, _mm_add_epi16(_mm_unpackhi_epi8(even1, zero), _mm_unpackhi_epi8(odd1, zero)));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int downscale_row_avx2(const uint32_t* src0, const uint32_t* src1, uint32_t* dst, int width){
+    int x = 0;
+    __m256i zero = _mm256_setzero_si256();
+    __m256i two = _mm256_set1_epi16(2);
+    for (; x + 8 <= width; x += 8){
+        // 16 source pixels per row, split into even and odd columns per lane
+        __m256 a0 = _mm256_loadu_ps((const float*)(src0 + 2 * x));
+        __m256 b0 = _mm256_loadu_ps((const float*)(src0 + 2 * x + 8));
+        __m256 a1 = _mm256_loadu_ps((const float*)(src1 + 2 * x));
+        __m256 b1 = _mm256_loadu_ps((const float*)(src1 + 2 * x + 8));
+        __m256i even0 = _mm256_castps_si256(_mm256_shuffle_ps(a0, b0, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m256i odd0 = _mm256_castps_si256(_mm256_shuffle_ps(a0, b0, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m256i even1 = _mm256_castps_si256(_mm256_shuffle_ps(a1, b1, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m256i odd1 = _mm256_castps_si256(_mm256_shuffle_ps(a1, b1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(even0, zero), _mm256_unpacklo_epi8(odd0, zero));
+        lo = _mm256_add_epi16(lo, _mm256_add_epi16(_mm256_unpacklo_epi8(even1, zero), _mm256_unpacklo_epi8(odd1, zero)));
+        __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(even0, zero), _mm256_unpackhi_epi8(odd0, zero));
+        hi = _mm256_add_epi16(hi, _mm256_add_epi16(_mm256_unpackhi_epi8(even1, zero), _mm256_unpackhi_epi8(odd1, zero)));
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, two), 2);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, two), 2);
+
+        // The lanes hold the output pixels in the order 0 1 4 5 | 2 3 6 7
+        __m256i result = _mm256_packus_epi16(lo, hi);
+        result = _mm256_permute4x64_epi64(result, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(dst + x), result);
+    }
+    return x;
+}
+#endif
+
+/**
+ * @brief downscales rows of a frame twice as large into a capture buffer,
+ *        averaging 2x2 pixels per channel (box filter), using AVX2 or SSE when
+ *        the CPU supports it (see cpu_simd_level()). Channel order is kept.
+ *
+ * @param
+ *      frame     : capture buffer, frame->width x frame->height
+ *      src       : source pixels, at least 2 * width x 2 * height
+ *      src_width : source pixels per row
+ *      first_row, end_row : rows [first_row, end_row) of the frame to fill
+ * @return
+ */
+void capture_downscale_2x(capture_frame_t* frame, const uint32_t* src, int src_width, int first_row, int end_row){
+    for (int y = first_row; y < end_row; y++){
+        const uint32_t* src0 = src + (size_t)(2 * y) * src_width;
+        const uint32_t* src1 = src0 + src_width;
+        uint32_t* dst = (uint32_t*)(frame->pixels + (size_t)y * frame->pitch);
+        int done = 0;
+#ifdef CAPTURE_X86_SIMD
+        switch (cpu_simd_level()){
+        case SIMD_AVX2:
+            done = downscale_row_avx2(src0, src1, dst, frame->width);
+            break;
+        case SIMD_SSE:
+            done = downscale_row_sse(src0, src1, dst, frame->width);
+            break;
+        }
+#endif
+        // remaining pixels, or all of them without SIMD
+        downscale_row_scalar(src0, src1, dst, done, frame->width);
+    }
+}
+
+const char* capture_policy_name(int policy){
+    switch (policy){
+    case CAPTURE_DROP:
+        return "drop";
+    case CAPTURE_GROW:
+        return "grow";
+    default:
+        return "block";
+    }
+}
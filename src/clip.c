@@ -2,8 +2,37 @@
 #include <math.h>
 #include "vector.h"
 
-#define NUM_PLANES 6
-plane_t frustum_planes[NUM_PLANES];
+#define NUM_PLANES 6       // the frustum
+#define NUM_CLIP_PLANES 10 // the frustum and the guard band
+plane_t frustum_planes[NUM_CLIP_PLANES];
+
+///////////////////////////////////////////////////////////////////////////////
+// In homogeneous clip space the same planes don't depend on the fov at all.
+// A vertex (x, y, z, w) is inside of a plane (a, b, c, d) when
+// a*x + b*y + c*z + d*w > 0, e.g. inside of the left plane when x > -w.
+///////////////////////////////////////////////////////////////////////////////
+// Left plane   :  x + w > 0       Right plane  : -x + w > 0
+// Top plane    : -y + w > 0       Bottom plane :  y + w > 0
+// Near plane   :  z > 0           Far plane    : -z + w > 0
+// Guard band   :  side planes with GUARD_BAND_SCALE * w
+///////////////////////////////////////////////////////////////////////////////
+static const vec4_t clip_space_planes[NUM_CLIP_PLANES] = {
+	{  1,  0,  0, 1 },
+	{ -1,  0,  0, 1 },
+	{  0, -1,  0, 1 },
+	{  0,  1,  0, 1 },
+	{  0,  0,  1, 0 },
+	{  0,  0, -1, 1 },
+	{  1,  0,  0, GUARD_BAND_SCALE },
+	{ -1,  0,  0, GUARD_BAND_SCALE },
+	{  0, -1,  0, GUARD_BAND_SCALE },
+	{  0,  1,  0, GUARD_BAND_SCALE }
+};
+
+static float clip_space_distance(int plane, vec4_t v){
+	vec4_t p = clip_space_planes[plane];
+	return p.x * v.x + p.y * v.y + p.z * v.z + p.w * v.w;
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 // Frustum planes are defined by a point and a normal vector (left-hand coord.)
@@ -74,6 +103,26 @@ void init_frustum_planes(float fov_x, float fov_y, float z_near, float z_far) {
 	frustum_planes[FAR_FRUSTUM_PLANE].normal.x = 0;
 	frustum_planes[FAR_FRUSTUM_PLANE].normal.y = 0;
 	frustum_planes[FAR_FRUSTUM_PLANE].normal.z = -1;
+
+	// guard band planes: same as the side planes, but with tan(fov/2) scaled up
+	float guard_fov_x = 2.0 * atan(GUARD_BAND_SCALE * tan(fov_x / 2));
+	float guard_fov_y = 2.0 * atan(GUARD_BAND_SCALE * tan(fov_y / 2));
+	float cos_half_guard_x = cos(guard_fov_x / 2);
+	float sin_half_guard_x = sin(guard_fov_x / 2);
+	float cos_half_guard_y = cos(guard_fov_y / 2);
+	float sin_half_guard_y = sin(guard_fov_y / 2);
+
+	frustum_planes[LEFT_GUARD_BAND_PLANE].point = vec3_new(0, 0, 0);
+	frustum_planes[LEFT_GUARD_BAND_PLANE].normal = vec3_new(cos_half_guard_x, 0, sin_half_guard_x);
+
+	frustum_planes[RIGHT_GUARD_BAND_PLANE].point = vec3_new(0, 0, 0);
+	frustum_planes[RIGHT_GUARD_BAND_PLANE].normal = vec3_new(-cos_half_guard_x, 0, sin_half_guard_x);
+
+	frustum_planes[TOP_GUARD_BAND_PLANE].point = vec3_new(0, 0, 0);
+	frustum_planes[TOP_GUARD_BAND_PLANE].normal = vec3_new(0, -cos_half_guard_y, sin_half_guard_y);
+
+	frustum_planes[BOTTOM_GUARD_BAND_PLANE].point = vec3_new(0, 0, 0);
+	frustum_planes[BOTTOM_GUARD_BAND_PLANE].normal = vec3_new(0, cos_half_guard_y, sin_half_guard_y);
 }
 
 polygon_t polygon_from_triangle(vec3_t v0, vec3_t v1, vec3_t v2, tex2_t t0, tex2_t t1, tex2_t t2){
@@ -103,6 +152,81 @@ void triangles_from_polygon(polygon_t* polygon, triangle_t triangles[], int* num
 	*num_traingles = polygon->num_vertices-2;
 }
 
+/**
+ * Classifies a bounding sphere in camera space against the six frustum planes.
+ *
+ * @param center Sphere center in camera space.
+ * @param radius Sphere radius in camera space.
+ * @return FRUSTUM_OUTSIDE, FRUSTUM_INSIDE or FRUSTUM_INTERSECT
+ */
+int frustum_classify_sphere(vec3_t center, float radius){
+	int result = FRUSTUM_INSIDE;
+	for (int plane = 0; plane < NUM_PLANES; plane++){
+		float distance = vec3_dot(vec3_sub(center, frustum_planes[plane].point), frustum_planes[plane].normal);
+		if (distance < -radius){
+			return FRUSTUM_OUTSIDE;
+		}
+		if (distance <= radius){
+			result = FRUSTUM_INTERSECT;
+		}
+	}
+	return result;
+}
+
+/**
+ * Classifies a point set in camera space (e.g. the corners of a bounding box)
+ * against the six frustum planes. Like in clip_polygon_against_plane, only
+ * points with a positive distance count as inside.
+ *
+ * @param points     Points in camera space.
+ * @param num_points Number of points.
+ * @return FRUSTUM_OUTSIDE, FRUSTUM_INSIDE or FRUSTUM_INTERSECT
+ */
+int frustum_classify_points(vec3_t points[], int num_points){
+	int result = FRUSTUM_INSIDE;
+	for (int plane = 0; plane < NUM_PLANES; plane++){
+		int num_inside = 0;
+		for (int i = 0; i < num_points; i++){
+			if (vec3_dot(vec3_sub(points[i], frustum_planes[plane].point), frustum_planes[plane].normal) > 0){
+				num_inside++;
+			}
+		}
+		if (num_inside == 0){
+			return FRUSTUM_OUTSIDE;
+		}
+		if (num_inside < num_points){
+			result = FRUSTUM_INTERSECT;
+		}
+	}
+	return result;
+}
+
+/**
+ * Computes the outcode of every vertex: bit `plane` is set when the vertex is
+ * not inside of that frustum or guard band plane (same test as
+ * clip_polygon_against_plane).
+ * A face whose outcodes AND to non-zero lies outside of one plane and is
+ * rejected, a face whose outcodes OR to zero is inside and needs no clipping.
+ *
+ * @param vertices Camera-space vertices.
+ * @param outcodes Output, one per vertex.
+ * @param count    Number of vertices.
+ * @return
+ */
+void compute_outcodes(const vec4_soa_t* vertices, outcode_t outcodes[], int count){
+	for (int i = 0; i < count; i++){
+		outcodes[i] = 0;
+	}
+	for (int plane = 0; plane < NUM_CLIP_PLANES; plane++){
+		vec3_t p = frustum_planes[plane].point;
+		vec3_t n = frustum_planes[plane].normal;
+		for (int i = 0; i < count; i++){
+			float dot = (vertices->x[i] - p.x) * n.x + (vertices->y[i] - p.y) * n.y + (vertices->z[i] - p.z) * n.z;
+			outcodes[i] |= (dot <= 0) << plane;
+		}
+	}
+}
+
 float float_lerp(float a, float b, float t){
 	return a + t*(b-a);
 }
@@ -190,11 +314,173 @@ void clip_polygon_against_plane(polygon_t* polygon, int plane){
 	polygon->num_vertices = num_inside_vertices;
 }
 
+/**
+ * Clips the polygon only against the planes in plane_mask, e.g. the OR of the
+ * outcodes of its vertices. Planes all vertices are inside of can't cut it.
+ * With the guard band, the mask holds the guard band planes instead of the
+ * side planes of the frustum.
+ *
+ * @param polygon    Polygon to clip in place.
+ * @param plane_mask One bit per frustum plane.
+ * @return
+ */
+void clip_polygon_against_planes(polygon_t* polygon, outcode_t plane_mask){
+	for (int plane = 0; plane < NUM_CLIP_PLANES && polygon->num_vertices > 0; plane++){
+		if (plane_mask & (1 << plane)){
+			clip_polygon_against_plane(polygon, plane);
+		}
+	}
+}
+
 void clip_polygon(polygon_t* polygon){
-	clip_polygon_against_plane(polygon, LEFT_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, RIGHT_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, TOP_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, BOTTOM_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, NEAR_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, FAR_FRUSTUM_PLANE);
+	clip_polygon_against_planes(polygon, OUTCODE_FRUSTUM_PLANES);
+}
+
+/**
+ * Computes the outcode of a clip-space vertex, see compute_outcodes().
+ *
+ * @param v Vertex in homogeneous clip space.
+ * @return One bit per plane the vertex is not inside of.
+ */
+outcode_t clip_space_outcode(vec4_t v){
+	outcode_t outcode = 0;
+	for (int plane = 0; plane < NUM_CLIP_PLANES; plane++){
+		outcode |= (clip_space_distance(plane, v) <= 0) << plane;
+	}
+	return outcode;
+}
+
+/**
+ * Computes the outcodes of a stream of clip-space vertices. The plane tests
+ * are plain compares against w, branch free over the structure-of-arrays
+ * stream, so the compiler can vectorize the loop.
+ *
+ * @param vertices Clip-space vertices (the w stream is required).
+ * @param outcodes Output, one per vertex.
+ * @param count    Number of vertices.
+ * @return
+ */
+void compute_clip_space_outcodes(const vec4_soa_t* vertices, outcode_t outcodes[], int count){
+	const float* x = vertices->x;
+	const float* y = vertices->y;
+	const float* z = vertices->z;
+	const float* w = vertices->w;
+	for (int i = 0; i < count; i++){
+		float gw = GUARD_BAND_SCALE * w[i];
+		outcodes[i] = (outcode_t)(
+			((x[i] + w[i] <= 0) << LEFT_FRUSTUM_PLANE) |
+			((w[i] - x[i] <= 0) << RIGHT_FRUSTUM_PLANE) |
+			((w[i] - y[i] <= 0) << TOP_FRUSTUM_PLANE) |
+			((y[i] + w[i] <= 0) << BOTTOM_FRUSTUM_PLANE) |
+			((z[i] <= 0) << NEAR_FRUSTUM_PLANE) |
+			((w[i] - z[i] <= 0) << FAR_FRUSTUM_PLANE) |
+			((x[i] + gw <= 0) << LEFT_GUARD_BAND_PLANE) |
+			((gw - x[i] <= 0) << RIGHT_GUARD_BAND_PLANE) |
+			((gw - y[i] <= 0) << TOP_GUARD_BAND_PLANE) |
+			((y[i] + gw <= 0) << BOTTOM_GUARD_BAND_PLANE));
+	}
+}
+
+/**
+ * Classifies a point set in clip space (e.g. the corners of a bounding box
+ * multiplied by the model-view-projection matrix) against the frustum.
+ *
+ * @param points     Points in homogeneous clip space.
+ * @param num_points Number of points.
+ * @return FRUSTUM_OUTSIDE, FRUSTUM_INSIDE or FRUSTUM_INTERSECT
+ */
+int frustum_classify_clip_points(vec4_t points[], int num_points){
+	outcode_t outcode_and = OUTCODE_FRUSTUM_PLANES;
+	outcode_t outcode_or = 0;
+	for (int i = 0; i < num_points; i++){
+		outcode_t outcode = clip_space_outcode(points[i]) & OUTCODE_FRUSTUM_PLANES;
+		outcode_and &= outcode;
+		outcode_or |= outcode;
+	}
+	if (outcode_and){
+		return FRUSTUM_OUTSIDE;
+	}
+	return outcode_or ? FRUSTUM_INTERSECT : FRUSTUM_INSIDE;
+}
+
+polygon4_t polygon4_from_triangle(vec4_t v0, vec4_t v1, vec4_t v2, tex2_t t0, tex2_t t1, tex2_t t2){
+	polygon4_t polygon = {
+		.vertices = {v0, v1, v2},
+		.texcoords = {t0, t1, t2},
+		.num_vertices = 3
+	};
+	return polygon;
+}
+
+/**
+ * Sutherland-Hodgman in homogeneous clip space, against the planes in
+ * plane_mask. Same as clip_polygon_against_plane(), with the signed distances
+ * of clip_space_planes instead of the camera-space plane equations.
+ *
+ * @param polygon    Polygon to clip in place.
+ * @param plane_mask One bit per plane.
+ * @return
+ */
+void clip_polygon4_against_planes(polygon4_t* polygon, outcode_t plane_mask){
+	for (int plane = 0; plane < NUM_CLIP_PLANES && polygon->num_vertices > 0; plane++){
+		if (!(plane_mask & (1 << plane))){
+			continue;
+		}
+
+		vec4_t inside_vertices[MAX_NUM_POLYGON_VERTICES];
+		tex2_t inside_texcoords[MAX_NUM_POLYGON_VERTICES];
+		int num_inside_vertices = 0;
+
+		int previous = polygon->num_vertices - 1;
+		float previous_dot = clip_space_distance(plane, polygon->vertices[previous]);
+		for (int current = 0; current < polygon->num_vertices; current++){
+			float current_dot = clip_space_distance(plane, polygon->vertices[current]);
+
+			// If we changed from inside to outside or vice-versa
+			if (current_dot * previous_dot < 0){
+				float t = previous_dot / (previous_dot - current_dot);
+				vec4_t* q1 = &polygon->vertices[previous];
+				vec4_t* q2 = &polygon->vertices[current];
+				inside_vertices[num_inside_vertices] = (vec4_t){
+					.x = float_lerp(q1->x, q2->x, t),
+					.y = float_lerp(q1->y, q2->y, t),
+					.z = float_lerp(q1->z, q2->z, t),
+					.w = float_lerp(q1->w, q2->w, t)
+				};
+				inside_texcoords[num_inside_vertices] = (tex2_t){
+					.u = float_lerp(polygon->texcoords[previous].u, polygon->texcoords[current].u, t),
+					.v = float_lerp(polygon->texcoords[previous].v, polygon->texcoords[current].v, t)
+				};
+				num_inside_vertices++;
+			}
+
+			// If current point is inside the plane
+			if (current_dot > 0){
+				inside_vertices[num_inside_vertices] = polygon->vertices[current];
+				inside_texcoords[num_inside_vertices] = polygon->texcoords[current];
+				num_inside_vertices++;
+			}
+			previous = current;
+			previous_dot = current_dot;
+		}
+
+		for (int i = 0; i < num_inside_vertices; i++){
+			polygon->vertices[i] = inside_vertices[i];
+			polygon->texcoords[i] = inside_texcoords[i];
+		}
+		polygon->num_vertices = num_inside_vertices;
+	}
+}
+
+void triangles_from_polygon4(polygon4_t* polygon, triangle_t triangles[], int* num_triangles){
+	for (int i = 0; i < polygon->num_vertices - 2; i++){
+		triangles[i].points[0] = polygon->vertices[0];
+		triangles[i].points[1] = polygon->vertices[i + 1];
+		triangles[i].points[2] = polygon->vertices[i + 2];
+
+		triangles[i].textcoords[0] = polygon->texcoords[0];
+		triangles[i].textcoords[1] = polygon->texcoords[i + 1];
+		triangles[i].textcoords[2] = polygon->texcoords[i + 2];
+	}
+	*num_triangles = polygon->num_vertices > 2 ? polygon->num_vertices - 2 : 0;
 }
@@ -0,0 +1,58 @@
+#include "cpu.h"
+
+static int detected_level = -1;
+static int max_level = SIMD_AVX2;
+
+/**
+ * @brief detects the best SIMD instruction set of the running CPU once.
+ *
+ * @param
+ * @return one of enum simd_level
+ */
+static int cpu_detect_simd_level(void){
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")){
+        return SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")){
+        return SIMD_SSE;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+/**
+ * @brief returns the SIMD level the kernels should use: the detected one,
+ *        capped by cpu_set_simd_level().
+ *
+ * @param
+ * @return one of enum simd_level
+ */
+int cpu_simd_level(void){
+    if (detected_level < 0){
+        detected_level = cpu_detect_simd_level();
+    }
+    return detected_level < max_level ? detected_level : max_level;
+}
+
+/**
+ * @brief caps the SIMD level, e.g. SIMD_SCALAR to force the portable paths.
+ *
+ * @param level: one of enum simd_level
+ * @return
+ */
+void cpu_set_simd_level(int level){
+    max_level = level;
+}
+
+const char* cpu_simd_level_name(int level){
+    switch (level){
+    case SIMD_AVX2:
+        return "avx2";
+    case SIMD_SSE:
+        return "sse4.1";
+    default:
+        return "scalar";
+    }
+}
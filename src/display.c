@@ -8,19 +8,30 @@
 #include "clip.h"
 #include "mesh.h"
 #include "draw.h"
+#include "profiler.h"
+#include "tile.h"
+#include "job.h"
+#include "capture.h"
+#include "stream.h"
+#include "image.h"
+#include <math.h>
 #include <SDL2/SDL_stdinc.h>
-#include <SDL2/SDL_image.h>
 
 // Save Variables
+#define CAPTURE_BUFFERS 4  // captured frames in flight
+#define CAPTURE_ENCODERS 2 // threads writing image files
+#define CAPTURE_BAND_ROWS 32 // captured rows per downscale job
+#define CAPTURE_SKIP_FRAMES (3 * FPS) // frames rendered before the capture starts
 static int save_width = 0;
 static int save_height = 0;
-static Uint8* save_pixels = NULL;
-static int save_pitch = 0;
-static SDL_Surface *save_surface = NULL;
-static SDL_Texture *save_texture = NULL;
 static bool is_export = false;
-static int capture_idx = 0;
+static int capture_policy = CAPTURE_BLOCK; // when every capture buffer is still being written
+static int capture_format = IMAGE_PNG;
+static const char* stream_path = NULL; // NULL: image files, else a video stream
+static int stream_format = STREAM_Y4M;
+static int capture_idx = 0; // frames captured, dropped ones do not count
 static int capture_max = 500;
+static int num_rendered_frames = 0;
 
 // Display Variables
 static SDL_Window *window = NULL;
@@ -32,8 +43,37 @@ static int window_width = 0;
 static int window_height = 0;
 static int previous_frame_time = 0;
 static float delta_time;
+static float fixed_delta_time = 0.0; // seconds per frame, 0: wall-clock
 static int render_method;
 static int cull_method;
+static int clip_method;
+static int pipeline_method;
+static int raster_method;
+
+// Headless Variables
+static bool is_headless = false;
+static int requested_width = 0;
+static int requested_height = 0;
+static int requested_threads = 0; // raster threads, 0: one per CPU
+static frame_sink_t frame_sink = NULL;
+static void* frame_sink_data = NULL;
+
+// Geometry Variables
+// The faces of every mesh are processed in chunks on the worker threads. Each
+// chunk writes to its own triangles, which are appended to the triangles to
+// render in mesh and face order, so the result doesn't depend on the threads.
+#define GEOMETRY_CHUNK_FACES 512
+
+typedef struct {
+    int mesh_index;
+    int first_face, end_face;     // faces [first_face, end_face) of the mesh
+    screen_triangle_t* triangles; // dynamic array, kept across frames
+} geometry_chunk_t;
+
+static geometry_chunk_t* geometry_chunks = NULL; // dynamic array, grows only
+static int num_geometry_chunks = 0;              // chunks of the current frame
+static int* mesh_frustum_results = NULL;         // dynamic array, one per mesh
+static job_counter_t geometry_jobs = { 0 };      // the geometry stage of update_async()
 
 ////////////////////////////////////////////////////////////////////////////////
 // Getters and Setters
@@ -63,18 +103,164 @@ float get_delta_time(void){
 void set_export(bool isExport){
     is_export = isExport;
 }
+void set_capture_policy(int policy){
+    capture_policy = policy;
+}
+void set_capture_format(int format){
+    capture_format = format;
+}
+void set_capture_stream(int format, const char* path){
+    stream_format = format;
+    stream_path = path;
+}
 void set_cull_method(int e){
     cull_method = e;
 }
 
+void set_clip_method(int e){
+    clip_method = e;
+}
+
+void set_pipeline_method(int e){
+    pipeline_method = e;
+}
+
+void set_raster_method(int e){
+    raster_method = e;
+}
+
 void set_render_method(int e){
     render_method = e;
 }
 
+void set_fixed_delta_time(float seconds){
+    fixed_delta_time = seconds;
+}
+
+void set_headless(bool isHeadless){
+    is_headless = isHeadless;
+}
+
+bool get_headless(void){
+    return is_headless;
+}
+
+void set_resolution(int width, int height){
+    requested_width = width;
+    requested_height = height;
+}
+
+// number of raster threads, including the main thread; call before initialize()
+void set_num_threads(int num_threads){
+    requested_threads = num_threads;
+}
+
+int get_num_threads(void){
+    return job_num_threads();
+}
+
+void set_frame_sink(frame_sink_t sink, void* user_data){
+    frame_sink = sink;
+    frame_sink_data = user_data;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Pipeline Functions
 ////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * @brief capture writer: writes a captured frame as an image file in the
+ *        capture format, on an encoder thread.
+ *
+ * @param frame: downsized frame, RGBA
+ *        user_data: unused
+ * @return returns false, when the file could not be written.
+ */
+static bool write_capture_file(const capture_frame_t* frame, void* user_data){
+    char path[256];
+    snprintf(path, sizeof(path), "../captures/frame_%04d.%s", frame->index, image_format_extension(capture_format));
+    if (!image_write(path, capture_format, frame->pixels, frame->width, frame->height, frame->pitch)){
+        return false;
+    }
+    printf("[cap] %s\n", path);
+    return true;
+}
+
+/**
+ * @brief allocates the color buffer, the z-buffer and the screen tiles in the
+ *        current resolution, and starts the raster threads.
+ *
+ * @param
+ * @return returns true, when the buffers are allocated.
+ */
+static bool initialize_buffers(void){
+
+    // Allocate the required bytes in memory for the color buffer.
+    color_buffer = (color_t*)malloc(sizeof(color_t) * window_width * window_height);
+    if (color_buffer == NULL){
+        return false;
+    }
+
+    // Allocate Z-buffer
+    z_buffer = (float*)malloc(sizeof(float) * window_width * window_height);
+    if (z_buffer == NULL){
+        return false;
+    }
+
+    // Tiles for the binned, multithreaded edge rasterizer
+    if (!init_tiles(window_width, window_height)){
+        return false;
+    }
+    if (!job_init(requested_threads)){
+        fprintf(stderr, "Rasterizing on the main thread only.\n");
+    }
+
+    // initialize Saver
+    // Allocate the capture ring of half-size frames for image files, or for a
+    // stream, written in order by a single encoder
+    if (is_export){
+        save_width  = window_width/2;
+        save_height = window_height/2;
+        if (stream_path != NULL){
+            int fps = fixed_delta_time > 0.0 ? (int)(1.0 / fixed_delta_time + 0.5) : FPS;
+            if (!stream_open(stream_path, stream_format, save_width, save_height, fps) ||
+                !capture_init(save_width, save_height, CAPTURE_BUFFERS, 1, capture_policy,
+                              stream_write_frame, NULL)){
+                return false;
+            }
+        }else if (!capture_init(save_width, save_height, CAPTURE_BUFFERS, CAPTURE_ENCODERS, capture_policy,
+                                write_capture_file, NULL)){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief initializes the offscreen buffers without any SDL video subsystem.
+ *        Resolution must be set beforehand with set_resolution().
+ *
+ * @param
+ * @return
+ */
+static bool initialize_headless(void){
+
+    // Only the timer is needed: SDL_GetTicks() and SDL_Delay()
+    if (SDL_Init(SDL_INIT_TIMER) != 0){
+        fprintf(stderr, "Error initializing SDL timer.\n");
+        return false;
+    }
+
+    window_width = requested_width;
+    window_height = requested_height;
+
+    if (window_height <= 0 || window_width <= 0){
+        fprintf(stderr, "Headless mode needs a resolution, see set_resolution().\n");
+        return false;
+    }
+    return initialize_buffers();
+}
+
 /**
  * @brief initializes an SDL window an its renderer.
  *
@@ -83,6 +269,10 @@ void set_render_method(int e){
  */
 bool initialize(void){ // keep it void argument for no parameter.
 
+    if (is_headless){
+        return initialize_headless();
+    }
+
     // Check if the SDL library initialization works
     if (SDL_Init(SDL_INIT_EVERYTHING) != 0){
         fprintf(stderr, "Error initializing SDL.\n");
@@ -95,9 +285,9 @@ bool initialize(void){ // keep it void argument for no parameter.
     int full_screen_width = display_mode.w; // fake full-screen
     int full_screen_height = display_mode.h;
 
-    // This will render color buffer in lower resolution
-    window_width = full_screen_width / 3;
-    window_height = full_screen_height / 3;
+    // This will render color buffer in lower resolution, unless the caller chose one.
+    window_width = requested_width > 0 ? requested_width : full_screen_width / 3;
+    window_height = requested_height > 0 ? requested_height : full_screen_height / 3;
 
     if (window_height == 0 || window_width == 0){
         return false;
@@ -126,15 +316,7 @@ bool initialize(void){ // keep it void argument for no parameter.
     }
     SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN);
 
-    // Allocate the required bytes in memory for the color buffer.
-    color_buffer = (color_t*)malloc(sizeof(color_t) * window_width * window_height);
-    if (color_buffer == NULL){
-        return false;
-    }
-
-    // Allocate Z-buffer
-    z_buffer = (float*)malloc(sizeof(float) * window_width * window_height);
-    if (z_buffer == NULL){
+    if (!initialize_buffers()){
         return false;
     }
 
@@ -151,46 +333,24 @@ bool initialize(void){ // keep it void argument for no parameter.
         return false;
     }
 
-    // initialize Saver
-    // Create an SDL texture that is used to save
-    // Allocate downsized pixel buffer (ARGB8888 = 4 bytes per pixel) for PNG export
-    save_width  = window_width/2;
-    save_height = window_height/2;
-    save_pitch  = save_width * 4;  // ARGB8888 => 4 bytes per pixel
-
-    // allocate save pixels
-    save_pixels = (Uint8 *)malloc(save_pitch * save_height);
-    if (!save_pixels) {
-        fprintf(stderr, "Memory allocation failed\n");
-        return false;
-    }
-
-
-    // Better downscale quality
-    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "2"); // "1" linear, "2" best available
-
-    save_texture = SDL_CreateTexture(renderer,
-                                 SDL_PIXELFORMAT_ARGB8888,
-                                 SDL_TEXTUREACCESS_TARGET,
-                                 save_width, save_height);
-    if (!save_texture) {
-        fprintf(stderr, "CreateTexture failed: %s\n", SDL_GetError());
-        return false;
-    }
     return true;
 }
 
 /**
- * @brief setup the color buffer, color buffer texture, etc.
+ * @brief sets the default render options, the projection matrix and the
+ *        frustum planes for the current resolution.
  *
  * @param
  * @return
  */
-bool setup(void){
+void setup_pipeline(void){
 
-    // Initialize render mode and triangle culling method
+    // Initialize render mode, triangle culling and clipping method
     render_method = RENDER_WIRE;
     cull_method = CULL_BACKFACE;
+    clip_method = CLIP_FRUSTUM;
+    pipeline_method = PIPELINE_CAMERA_SPACE;
+    raster_method = RASTER_EDGE;
 
     // initialize projection matrix and frustum planes
     float znear = init_znear(1.0);
@@ -205,6 +365,17 @@ bool setup(void){
 
     // initialilze frustum planes with a point and a normal
     init_frustum_planes(fov_x, fov_y, znear, zfar);
+}
+
+/**
+ * @brief setup the color buffer, color buffer texture, etc.
+ *
+ * @param
+ * @return
+ */
+bool setup(void){
+
+    setup_pipeline();
 
     // Load Multiple Meshes
     if (!load_mesh("../assets/f22.obj", "../assets/f22.png", vec3_new(1, 1, 1), vec3_new(-3, 0, 8), vec3_new(0.0, 0.0, 0.0))){
@@ -218,6 +389,140 @@ bool setup(void){
     return true;
 }
 
+/**
+ * @brief trivial accept/reject of a face with the outcodes of its vertices.
+ *
+ * @param mesh: mesh with up to date outcodes (only read when the mesh
+ *              straddles the frustum)
+ *        face: face to test
+ *        frustum_result: result of the bounding volume test of the mesh
+ *        clip_mask: returns the planes the face has to be clipped against
+ * @return returns false, when the face is outside of one frustum plane.
+ */
+static bool get_face_clip_mask(mesh_t* mesh, face_t face, int frustum_result, outcode_t* clip_mask){
+    *clip_mask = 0;
+    if (frustum_result != FRUSTUM_INTERSECT) {
+        return true;
+    }
+
+    // Trivial reject: all three vertices are outside of the same plane.
+    // Trivial accept: all three are inside of every plane.
+    outcode_t a = mesh->outcodes[face.a];
+    outcode_t b = mesh->outcodes[face.b];
+    outcode_t c = mesh->outcodes[face.c];
+    if (a & b & c & OUTCODE_FRUSTUM_PLANES) {
+        return false;
+    }
+
+    // With the guard band, crossing a side plane is left to the rasterizer
+    *clip_mask = (a | b | c) & ((clip_method == CLIP_GUARD_BAND)
+                                ? (OUTCODE_NEAR_FAR_PLANES | OUTCODE_GUARD_BAND_PLANES)
+                                : OUTCODE_FRUSTUM_PLANES);
+    return true;
+}
+
+/**
+ * @brief back-face culling and flat shading of a face in camera space.
+ *
+ * @param vertices: camera-space vertices of the face
+ *        face_color: unlit color of the face
+ *        color: returns the lit color
+ * @return returns false, when the face is culled.
+ */
+static bool cull_and_shade_face(vec4_t vertices[3], color_t face_color, color_t* color){
+
+    // Calculate the triangle face normal
+    PROFILE_BEGIN(PROF_CULL);
+    vec3_t vec_normal = get_triangle_normal(vertices);
+
+    // Back-face Culling
+    if (cull_method == CULL_BACKFACE) {
+
+        // Find the vector between vectorA in the triangle and the camera origin
+        vec3_t camera_ray = vec3_sub(vec3_from_vec4(vertices[0]), vec3_new(0, 0, 0)); // from A to camera position
+        vec3_normalize(&camera_ray);
+
+        // Calculate how aligned the camera ray is with the face normal (dot product)
+        float cos_angle_normal_camera = vec3_dot(vec_normal, camera_ray);
+
+        // Back face Culling, bypass triangles that are looking away from the camera.
+        if (cos_angle_normal_camera > 0) { // invisible: beyond 90°
+            PROFILE_END(PROF_CULL);
+            PROFILE_COUNT(PROF_FACES_CULLED, 1);
+            return false;
+        }
+    }
+    PROFILE_END(PROF_CULL);
+
+    // Lighting
+    light_t light = get_light();
+    float cos_angle_normal_light = -vec3_dot(vec_normal, light.direction); // inverse
+    *color = (color_t)light_apply_intensity(face_color, cos_angle_normal_light);
+    return true;
+}
+
+/**
+ * @brief maps a triangle after the perspective divide to the screen and
+ *        appends it to the triangles of a geometry chunk.
+ *
+ * @param projected_points: x, y and z after the perspective divide, w keeps
+ *                          the camera-space depth for perspective correction
+ *        textcoords, color, material: attributes of the triangle
+ *        output: dynamic array of the chunk's triangles
+ * @return
+ */
+static void emit_triangle(vec4_t projected_points[3], tex2_t textcoords[3], color_t color, int material,
+                          screen_triangle_t** output){
+    screen_triangle_t triangle_to_render;
+    for (int j = 0; j < 3; j++) {
+
+        // Invert y values
+        projected_points[j].y *= (-1.0);
+
+        // Scale
+        projected_points[j].x *= (float)window_width / 2.0;
+        projected_points[j].y *= (float)window_height / 2.0;
+
+        // Translate the projected points to the middle of the screen
+        projected_points[j].x += (float)window_width / 2.0;
+        projected_points[j].y += (float)window_height / 2.0;
+
+        // Snap to the subpixel grid
+        triangle_to_render.x[j] = edge_snap(projected_points[j].x);
+        triangle_to_render.y[j] = edge_snap(projected_points[j].y);
+        triangle_to_render.inv_w[j] = 1.0 / projected_points[j].w;
+        triangle_to_render.uv[j] = tex2_pack(textcoords[j]);
+    }
+    triangle_to_render.color = color;
+    triangle_to_render.material = (uint16_t)material;
+
+    // Save the projected triangle in the triangles of the chunk
+    array_push(*output, triangle_to_render);
+    PROFILE_COUNT(PROF_TRIANGLES_EMITTED, 1);
+}
+
+/**
+ * @brief bounding volume test of the mesh, see mesh_classify_frustum().
+ *
+ * @param mesh
+ * @return returns FRUSTUM_OUTSIDE, FRUSTUM_INSIDE or FRUSTUM_INTERSECT
+ */
+static int classify_mesh(mesh_t* mesh){
+    PROFILE_BEGIN(PROF_CLIP);
+    int frustum_result = (pipeline_method == PIPELINE_CLIP_SPACE)
+        ? mesh_classify_clip_space(mesh)
+        : mesh_classify_frustum(mesh);
+    PROFILE_END(PROF_CLIP);
+
+    if (frustum_result == FRUSTUM_OUTSIDE) {
+        PROFILE_COUNT(PROF_MESHES_CULLED, 1);
+    }
+    if (frustum_result == FRUSTUM_INSIDE) {
+        PROFILE_COUNT(PROF_MESHES_UNCLIPPED, 1);
+    }
+    return frustum_result;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Process the graphics pipeline stages for all the mesh triangles
 ///////////////////////////////////////////////////////////////////////////////
@@ -243,197 +548,586 @@ bool setup(void){
 //                        `--> | Screen space |  <-- ready to render
 //                             +--------------+
 ///////////////////////////////////////////////////////////////////////////////
-void process_graphics_pipeline_stages(mesh_t* mesh){
-    // Create the view matrix
-    // initialize the target looking at the positive z-axis
-    vec3_t target = {0, 0, 1};
-    vec3_t up_direction = {0, 1, 0};
-    set_target(&target); // rotate the camera direction
-    set_view_mat(target, up_direction);
-
-    // Create a scale, rotation, and translation mamtrix that will be used to multiply the mesh vertices
-    mat4_t scale_matrix = mat4_make_scale(mesh->scale.x, mesh->scale.y, mesh->scale.z);
-    mat4_t translation_matrix = mat4_make_translation(mesh->translation.x, mesh->translation.y, mesh->translation.z);
-    mat4_t rotation_matrix_x = mat4_make_rotation_x(mesh->rotation.x);
-    mat4_t rotation_matrix_y = mat4_make_rotation_y(mesh->rotation.y);
-    mat4_t rotation_matrix_z = mat4_make_rotation_z(mesh->rotation.z);
-
-    // loop over all trinagle faces of the mesh
-    int num_faces = array_length(mesh->faces);
-    for (int i = 0; i < num_faces; i++) {
-        face_t mesh_face = mesh->faces[i];
-        vec3_t face_vertices[3];
-        face_vertices[0] = mesh->vertices[mesh_face.a];
-        face_vertices[1] = mesh->vertices[mesh_face.b];
-        face_vertices[2] = mesh->vertices[mesh_face.c];
-
-        vec4_t transformed_vertices[3];
-        // Loop all three vertices of this current face and apply
-        // transformations
-        for (int j = 0; j < 3; j++) {
-
-            vec4_t transformed_vertex = vec4_from_vec3(face_vertices[j]);
+/**
+ * @brief transforms the vertices of a mesh that isn't outside of the frustum
+ *        to camera space, the per-mesh part of the camera-space pipeline.
+ *
+ * @param mesh
+ *        frustum_result: result of classify_mesh()
+ * @return
+ */
+static void transform_camera_space_vertices(mesh_t* mesh, int frustum_result){
+
+    // Transform every vertex once per frame into the camera-space vertex cache,
+    // faces shared by a vertex only look it up by index afterwards.
+    PROFILE_BEGIN(PROF_TRANSFORM);
+    mat4_mul_vec4_batch(&mesh->model_view_mat, &mesh->positions, &mesh->camera_vertices, mesh->positions.count);
+    PROFILE_END(PROF_TRANSFORM);
+
+    // Outcodes of the cached vertices, only needed when the mesh straddles the
+    // frustum. Inside meshes accept every face trivially.
+    if (frustum_result == FRUSTUM_INTERSECT) {
+        PROFILE_BEGIN(PROF_CLIP);
+        compute_outcodes(&mesh->camera_vertices, mesh->outcodes, mesh->positions.count);
+        PROFILE_END(PROF_CLIP);
+    }
+}
 
-            // Use a matrix to scale, translate, and rotate the original vertex
-            mat4_t world_mat = mat4_identity();
+/**
+ * @brief culls, shades, clips and projects a range of faces of a mesh whose
+ *        vertices are transformed. Only reads the mesh, so ranges of the same
+ *        mesh run in parallel.
+ *
+ * @param mesh
+ *        frustum_result: result of classify_mesh()
+ *        first_face, end_face: faces [first_face, end_face)
+ *        output: dynamic array the screen triangles are appended to
+ * @return
+ */
+static void process_camera_space_faces(mesh_t* mesh, int frustum_result, int first_face, int end_face,
+                                       screen_triangle_t** output){
 
-            // Order matters: scale -> rotate -> translate
-            world_mat = mat4_mul_mat4(scale_matrix, world_mat);
-            world_mat = mat4_mul_mat4(rotation_matrix_x, world_mat);
-            world_mat = mat4_mul_mat4(rotation_matrix_y, world_mat);
-            world_mat = mat4_mul_mat4(rotation_matrix_z, world_mat);
-            world_mat = mat4_mul_mat4(translation_matrix, world_mat);
+    // Once per range, not per projected vertex
+    mat4_t proj_mat = get_proj_mat();
 
-            // multiply the world matrix by the original vector
-            transformed_vertex = mat4_mul_vec4(world_mat, transformed_vertex);
+    // loop over the trinagle faces of the range
+    for (int i = first_face; i < end_face; i++) {
+        face_t mesh_face = mesh->faces[i];
 
-            // Multiply the view matrix by the vector to transform the scene to
-            // camera space
-            transformed_vertex = mat4_mul_vec4(get_view_mat(), transformed_vertex);
+        // Assemble the face from the cached camera-space vertices
+        vec4_soa_t* cache = &mesh->camera_vertices;
+        vec4_t transformed_vertices[3] = {
+            { cache->x[mesh_face.a], cache->y[mesh_face.a], cache->z[mesh_face.a], 1.0 },
+            { cache->x[mesh_face.b], cache->y[mesh_face.b], cache->z[mesh_face.b], 1.0 },
+            { cache->x[mesh_face.c], cache->y[mesh_face.c], cache->z[mesh_face.c], 1.0 }
+        };
+        PROFILE_COUNT(PROF_FACES_IN, 1);
 
-            // Save transformed vertex in the array of transformed vertices
-            transformed_vertices[j] = transformed_vertex;
+        outcode_t clip_mask;
+        if (!get_face_clip_mask(mesh, mesh_face, frustum_result, &clip_mask)) {
+            PROFILE_COUNT(PROF_FACES_REJECTED, 1);
+            continue;
         }
 
-        // Calculate the triangle face normal
-        vec3_t vec_normal = get_triangle_normal(transformed_vertices);
-
-        // Back-face Culling
-        if (cull_method == CULL_BACKFACE) {
-
-            // Find the vector between vectorA in the triangle and the camera origin
-            vec3_t camera_ray = vec3_sub(vec3_from_vec4(transformed_vertices[0]), vec3_new(0, 0, 0)); // from A to camera position
-            vec3_normalize(&camera_ray);
-
-            // Calculate how aligned the camera ray is with the face normal (dot product)
-            float cos_angle_normal_camera = vec3_dot(vec_normal, camera_ray);
-
-            // Back face Culling, bypass triangles that are looking away from the camera.
-            if (cos_angle_normal_camera > 0) { // invisible: beyond 90°
-                continue;
-            }
+        color_t new_color;
+        if (!cull_and_shade_face(transformed_vertices, mesh_face.color, &new_color)) {
+            continue;
         }
 
-        // Lighting
-        light_t light = get_light();
-        float cos_angle_normal_light = -vec3_dot(vec_normal, light.direction); // inverse
-        color_t new_color = (color_t)light_apply_intensity(mesh_face.color, cos_angle_normal_light);
-
         // Create a polygon from the original transform
+        PROFILE_BEGIN(PROF_CLIP);
         polygon_t polygon = polygon_from_triangle(
             vec3_from_vec4(transformed_vertices[0]),
             vec3_from_vec4(transformed_vertices[1]),
             vec3_from_vec4(transformed_vertices[2]),
-            mesh_face.a_uv,
-            mesh_face.b_uv,
-            mesh_face.c_uv);
+            mesh->texcoords[mesh_face.a_uv],
+            mesh->texcoords[mesh_face.b_uv],
+            mesh->texcoords[mesh_face.c_uv]);
 
         // clip the polygon and return a new polygon with potential new
         // vertices
-        clip_polygon(&polygon);
-        /* printf("Number of polygon vertices after clipping: %d\n",
-         * polygon.num_vertices); */
+        if (clip_mask != 0) {
+            clip_polygon_against_planes(&polygon, clip_mask);
+            PROFILE_COUNT(PROF_FACES_STRADDLING, 1);
+        } else {
+            PROFILE_COUNT(PROF_FACES_ACCEPTED, 1);
+        }
 
         // Break the clipped polygon apart back into individual triangles
         triangle_t triangles_after_clipping[MAX_NUM_POLYGON_TRIANGLES];
         int num_traingles_after_clipping = 0;
         triangles_from_polygon(&polygon, triangles_after_clipping,
                                &num_traingles_after_clipping);
+        PROFILE_END(PROF_CLIP);
+        if (num_traingles_after_clipping <= 0) {
+            PROFILE_COUNT(PROF_FACES_CLIPPED, 1);
+        }
 
         // Loops all the assembled triangle after clipping
         for (int t = 0; t < num_traingles_after_clipping; t++) {
 
+            PROFILE_BEGIN(PROF_PROJECT);
             triangle_t triangle_after_clipping = triangles_after_clipping[t];
             vec4_t projected_points[3];
 
-            // Loop all three vertices to perform projection and conversion to
-            // screen space.
+            // Project all three vertices, emit_triangle() converts them to screen space
             for (int j = 0; j < 3; j++) {
+                projected_points[j] = mat4_mul_vec4_project(proj_mat, triangle_after_clipping.points[j]);
+            }
+            emit_triangle(projected_points, triangle_after_clipping.textcoords, new_color, mesh->material, output);
+            PROFILE_END(PROF_PROJECT);
+        }
+    }
+}
 
-                // Project the current vertex
-                projected_points[j] = mat4_mul_vec4_project(get_proj_mat(), triangle_after_clipping.points[j]);
+///////////////////////////////////////////////////////////////////////////////
+// The same stages in homogeneous clip space
+///////////////////////////////////////////////////////////////////////////////
+// +-------------+
+// | Model space |  <-- original mesh vertices
+// +-------------+
+// |   +-------------+
+// `-> | Clip space  |  <-- multiply by model-view-projection matrix
+//     +-------------+
+//     |   +------------+
+//     `-> |  Clipping  |  <-- clip against x, y, z = +-w (see clip.c)
+//         +------------+
+//         |    +-------------+
+//         `--> | Image space |  <-- apply perspective divide
+//              +-------------+
+//              |    +--------------+
+//              `--> | Screen space |  <-- ready to render
+//                   +--------------+
+///////////////////////////////////////////////////////////////////////////////
+static void transform_clip_space_vertices(mesh_t* mesh, int frustum_result){
+
+    // One batch multiply by the combined matrix, and the outcodes as plain
+    // compares against w, no trigonometric planes and no projection pass.
+    PROFILE_BEGIN(PROF_TRANSFORM);
+    mat4_mul_vec4_batch(&mesh->mvp_mat, &mesh->positions, &mesh->clip_vertices, mesh->positions.count);
+    PROFILE_END(PROF_TRANSFORM);
+    if (frustum_result == FRUSTUM_INTERSECT) {
+        PROFILE_BEGIN(PROF_CLIP);
+        compute_clip_space_outcodes(&mesh->clip_vertices, mesh->outcodes, mesh->positions.count);
+        PROFILE_END(PROF_CLIP);
+    }
+}
 
-                // Invert y values
-                projected_points[j].y *= (-1.0);
+// The face stages in clip space, see process_camera_space_faces()
+static void process_clip_space_faces(mesh_t* mesh, int frustum_result, int first_face, int end_face,
+                                     screen_triangle_t** output){
+
+    // The perspective matrix only scales x and y and moves the depth into w,
+    // culling and lighting undo that to get the camera-space face.
+    mat4_t proj_mat = get_proj_mat();
+    float inv_scale_x = 1.0 / proj_mat.m[0][0];
+    float inv_scale_y = 1.0 / proj_mat.m[1][1];
+
+    for (int i = first_face; i < end_face; i++) {
+        face_t mesh_face = mesh->faces[i];
+        PROFILE_COUNT(PROF_FACES_IN, 1);
 
-                // Scale
-                projected_points[j].x *= (float)window_width / 2.0;
-                projected_points[j].y *= (float)window_height / 2.0;
+        outcode_t clip_mask;
+        if (!get_face_clip_mask(mesh, mesh_face, frustum_result, &clip_mask)) {
+            PROFILE_COUNT(PROF_FACES_REJECTED, 1);
+            continue;
+        }
+
+        // Assemble the face from the cached clip-space vertices
+        vec4_soa_t* cache = &mesh->clip_vertices;
+        int indices[3] = { mesh_face.a, mesh_face.b, mesh_face.c };
+        vec4_t clip_vertices[3];
+        vec4_t camera_vertices[3];
+        for (int j = 0; j < 3; j++) {
+            int k = indices[j];
+            clip_vertices[j] = (vec4_t){ cache->x[k], cache->y[k], cache->z[k], cache->w[k] };
+            camera_vertices[j] = (vec4_t){ cache->x[k] * inv_scale_x, cache->y[k] * inv_scale_y, cache->w[k], 1.0 };
+        }
+
+        color_t new_color;
+        if (!cull_and_shade_face(camera_vertices, mesh_face.color, &new_color)) {
+            continue;
+        }
+
+        PROFILE_BEGIN(PROF_CLIP);
+        polygon4_t polygon = polygon4_from_triangle(
+            clip_vertices[0], clip_vertices[1], clip_vertices[2],
+            mesh->texcoords[mesh_face.a_uv],
+            mesh->texcoords[mesh_face.b_uv],
+            mesh->texcoords[mesh_face.c_uv]);
+        if (clip_mask != 0) {
+            clip_polygon4_against_planes(&polygon, clip_mask);
+            PROFILE_COUNT(PROF_FACES_STRADDLING, 1);
+        } else {
+            PROFILE_COUNT(PROF_FACES_ACCEPTED, 1);
+        }
+
+        triangle_t triangles_after_clipping[MAX_NUM_POLYGON_TRIANGLES];
+        int num_triangles_after_clipping = 0;
+        triangles_from_polygon4(&polygon, triangles_after_clipping, &num_triangles_after_clipping);
+        PROFILE_END(PROF_CLIP);
+        if (num_triangles_after_clipping <= 0) {
+            PROFILE_COUNT(PROF_FACES_CLIPPED, 1);
+        }
 
-                // Translate the projected points to the middle of the screen
-                projected_points[j].x += (float)window_width / 2.0;
-                projected_points[j].y += (float)window_height / 2.0;
+        for (int t = 0; t < num_triangles_after_clipping; t++) {
+            PROFILE_BEGIN(PROF_PROJECT);
+            vec4_t projected_points[3];
+
+            // Perspective divide, w keeps the depth for perspective correction
+            for (int j = 0; j < 3; j++) {
+                vec4_t v = triangles_after_clipping[t].points[j];
+                if (fabs(v.w) > 1e-6) {
+                    v.x /= v.w;
+                    v.y /= v.w;
+                    v.z /= v.w;
+                }
+                projected_points[j] = v;
             }
+            emit_triangle(projected_points, triangles_after_clipping[t].textcoords, new_color, mesh->material, output);
+            PROFILE_END(PROF_PROJECT);
+        }
+    }
+}
 
-            triangle_t triangle_to_render = {
-            .points = {
-            {projected_points[0].x, projected_points[0].y,projected_points[0].z, projected_points[0].w},
-            {projected_points[1].x, projected_points[1].y,projected_points[1].z, projected_points[1].w},
-            {projected_points[2].x, projected_points[2].y,projected_points[2].z, projected_points[2].w}},
-            .textcoords = {
-            {triangle_after_clipping.textcoords[0].u,triangle_after_clipping.textcoords[0].v},
-            {triangle_after_clipping.textcoords[1].u,triangle_after_clipping.textcoords[1].v},
-            {triangle_after_clipping.textcoords[2].u,triangle_after_clipping.textcoords[2].v}},
-            .color = new_color,
-            .texture = mesh->texture
-        };
+/**
+ * @brief per-mesh geometry job: updates the matrices of one mesh, tests its
+ *        bounding volume and transforms its vertices in the selected pipeline.
+ *
+ * @param data: unused
+ *        index: mesh
+ * @return
+ */
+static void prepare_mesh_job(void* data, int index){
+    mesh_t* mesh = get_mesh(index);
+
+    // Rebuild the cached matrices, if the mesh or the camera changed
+    mesh_update_matrices(mesh);
+
+    // Bounding volume test: meshes fully outside of the frustum are skipped
+    // entirely, meshes fully inside of it don't need per-polygon clipping.
+    int frustum_result = classify_mesh(mesh);
+    mesh_frustum_results[index] = frustum_result;
+    if (frustum_result == FRUSTUM_OUTSIDE) {
+        return;
+    }
+
+    if (pipeline_method == PIPELINE_CLIP_SPACE) {
+        transform_clip_space_vertices(mesh, frustum_result);
+    } else {
+        transform_camera_space_vertices(mesh, frustum_result);
+    }
+}
+
+/**
+ * @brief per-chunk geometry job: runs the face stages of one chunk into the
+ *        chunk's own triangles.
+ *
+ * @param data: unused
+ *        index: chunk
+ * @return
+ */
+static void process_chunk_job(void* data, int index){
+    geometry_chunk_t* chunk = &geometry_chunks[index];
+    mesh_t* mesh = get_mesh(chunk->mesh_index);
+    int frustum_result = mesh_frustum_results[chunk->mesh_index];
+
+    array_clear(chunk->triangles);
+    if (pipeline_method == PIPELINE_CLIP_SPACE) {
+        process_clip_space_faces(mesh, frustum_result, chunk->first_face, chunk->end_face, &chunk->triangles);
+    } else {
+        process_camera_space_faces(mesh, frustum_result, chunk->first_face, chunk->end_face, &chunk->triangles);
+    }
+}
 
-            // Save the projected triangle in the array of triangles
-            int num_triangles_to_render = get_num_triangles_to_render();
-            if (num_triangles_to_render < MAX_TRIANGLES_PER_MESH) {
-                update_triangles_to_render(num_triangles_to_render, triangle_to_render);
-                num_triangles_to_render++;
-                set_num_triangles_to_render(num_triangles_to_render);
+/**
+ * @brief splits the faces of the meshes that aren't outside of the frustum
+ *        into chunks of GEOMETRY_CHUNK_FACES, in mesh and face order.
+ *
+ * @param
+ * @return
+ */
+static void split_geometry_chunks(void){
+    num_geometry_chunks = 0;
+    for (int mesh_index = 0; mesh_index < get_num_meshes(); mesh_index++){
+        if (mesh_frustum_results[mesh_index] == FRUSTUM_OUTSIDE){
+            continue;
+        }
+        int num_faces = array_length(get_mesh(mesh_index)->faces);
+        for (int first_face = 0; first_face < num_faces; first_face += GEOMETRY_CHUNK_FACES){
+            if (num_geometry_chunks == array_length(geometry_chunks)){
+                geometry_chunk_t chunk = { 0, 0, 0, NULL };
+                array_push(geometry_chunks, chunk);
             }
+            geometry_chunk_t* chunk = &geometry_chunks[num_geometry_chunks++];
+            chunk->mesh_index = mesh_index;
+            chunk->first_face = first_face;
+            chunk->end_face = first_face + GEOMETRY_CHUNK_FACES < num_faces ? first_face + GEOMETRY_CHUNK_FACES : num_faces;
         }
     }
 }
 
 /**
- * @brief updates the next frame
+ * @brief runs the geometry stages of all meshes in the selected pipeline on
+ *        the worker threads, first per mesh, then per chunk of faces, and
+ *        appends the visible triangles to the triangles to render.
  *
  * @param
  * @return
  */
-void update(void){
+static void process_graphics_pipeline_stages(void){
+    PROFILE_BEGIN(PROF_GEOMETRY);
+
+    int num_meshes = get_num_meshes();
+    array_clear(mesh_frustum_results);
+    mesh_frustum_results = array_hold(mesh_frustum_results, num_meshes, sizeof(int));
+    job_parallel_for(prepare_mesh_job, NULL, num_meshes, PROF_GEOMETRY);
+
+    split_geometry_chunks();
+    job_parallel_for(process_chunk_job, NULL, num_geometry_chunks, PROF_GEOMETRY);
+
+    // Merge in chunk order: the same triangles as processing the faces one by one
+    for (int i = 0; i < num_geometry_chunks; i++){
+        append_triangles_to_render(geometry_chunks[i].triangles, array_length(geometry_chunks[i].triangles));
+    }
+    PROFILE_END(PROF_GEOMETRY);
+}
+
+/**
+ * @brief advances the frame time: waits for the target frame time, unless
+ *        unthrottled, and sets the delta time.
+ *
+ * @param
+ * @return
+ */
+static void advance_frame_time(void){
 
     // Note: This will control the FPS.
     // Wait some time until the it reaches the target frame time in milliseconds
     int time_to_wait = FRAME_TARGET_TIME - (SDL_GetTicks() - previous_frame_time);
 
-    // Only delay execution if we are running too fast
-    if (time_to_wait > 0 && time_to_wait <= FRAME_TARGET_TIME) {
+    // Only delay execution if we are running too fast (headless and fixed
+    // time step runs are unthrottled)
+    if (!is_headless && fixed_delta_time <= 0.0 && time_to_wait > 0 && time_to_wait <= FRAME_TARGET_TIME) {
         SDL_Delay(time_to_wait);
     }
 
     // Note: This controls the unit transformations per second, not per frame.
     // Get a delta time factor converted to seconds to be used to update our game objects
     // Note: having the delta-time ensures how many units I want to change per second, not per frame.
-    delta_time = (SDL_GetTicks() - previous_frame_time)/1000.0;
+    // A fixed time step makes the animation reproducible, regardless of the frame rate.
+    if (fixed_delta_time > 0.0){
+        delta_time = fixed_delta_time;
+    }else{
+        delta_time = (SDL_GetTicks() - previous_frame_time)/1000.0;
+    }
 
     previous_frame_time = SDL_GetTicks(); // Initiate after hitting SDL_INIT
+}
+
+/**
+ * @brief animates the camera and the meshes of the next frame, and empties
+ *        the back list of triangles for its geometry stage.
+ *
+ * @param
+ * @return
+ */
+static void animate_scene(void){
+
+    // Empty the triangles to render for the current frame, keeping their memory.
+    clear_triangles_to_render();
 
-    // Initialize the counter of triangles to render for the current frame.
-    set_num_triangles_to_render(0);
+    // Create the view matrix once per frame
+    // initialize the target looking at the positive z-axis
+    vec3_t target = {0, 0, 1};
+    vec3_t up_direction = {0, 1, 0};
+    set_target(&target); // rotate the camera direction
+    set_view_mat(target, up_direction);
 
     for (int mesh_index = 0; mesh_index < get_num_meshes(); mesh_index++){
         mesh_t* mesh = get_mesh(mesh_index);
 
         // Change the mesh scale, rotation, and translation values per animation frame
-        mesh->rotation.x += 0.6 * delta_time;
-        mesh->rotation.y += 0.4 * delta_time;
-        mesh->rotation.z += 0.8 * delta_time;
+        vec3_t rotation = mesh->rotation;
+        rotation.x += 0.6 * delta_time;
+        rotation.y += 0.4 * delta_time;
+        rotation.z += 0.8 * delta_time;
+        mesh_set_rotation(mesh, rotation);
         /* mesh->translation.z += 0.0 * delta_time; */
 
         // Change the camera position per animation frame
         /* camera.position.x += 0.5*delta_time; */
         /* camera.position.y += 0.5*delta_time; */
+    }
+}
+
+/**
+ * @brief updates the next frame, the triangles to render are the new ones
+ *        afterwards.
+ *
+ * @param
+ * @return
+ */
+void update(void){
+    advance_frame_time();
+
+    PROFILE_BEGIN(PROF_UPDATE);
+    animate_scene();
+
+    // Process the graphics pipeline stages for every mesh of our 3D scene.
+    process_graphics_pipeline_stages();
+    swap_triangles_to_render();
+    PROFILE_END(PROF_UPDATE);
+}
+
+// the geometry stage of update_async(), as one job that fans out itself
+static void geometry_job(void* data, int index){
+    process_graphics_pipeline_stages();
+}
+
+/**
+ * @brief starts updating the next frame: animates it, and runs its geometry
+ *        stage on the job threads. Until update_wait(), render() still draws
+ *        the previous frame, overlapping with the geometry. The meshes must
+ *        not change meanwhile, and the first frame after loading them has to
+ *        come from update().
+ *
+ * @param
+ * @return
+ */
+void update_async(void){
+    advance_frame_time();
 
-        // Process the graphics pipeline stages foro every mesh of our 3D scene.
-        process_graphics_pipeline_stages(mesh);
+    PROFILE_BEGIN(PROF_UPDATE);
+    animate_scene();
+    job_submit(geometry_job, NULL, 1, PROF_UPDATE, NULL, &geometry_jobs);
+    PROFILE_END(PROF_UPDATE);
+}
+
+/**
+ * @brief finishes update_async(): waits for the geometry stage, and makes its
+ *        triangles the ones to render.
+ *
+ * @param
+ * @return
+ */
+void update_wait(void){
+    job_wait(&geometry_jobs);
+    swap_triangles_to_render();
+}
+
+
+/**
+ * @brief draws one screen triangle in the current render method.
+ *
+ * @param triangle: screen triangle
+ *        clip: pixels to draw to; the edge rasterizer and the wireframe
+ *              honor it, the scanline rasterizer always draws the viewport
+ * @return
+ */
+static void draw_screen_triangle(const screen_triangle_t* triangle, const rect_t* clip){
+
+    // pixel coordinates of the vertices
+    int x0 = triangle->x[0] >> SUBPIXEL_BITS, y0 = triangle->y[0] >> SUBPIXEL_BITS;
+    int x1 = triangle->x[1] >> SUBPIXEL_BITS, y1 = triangle->y[1] >> SUBPIXEL_BITS;
+    int x2 = triangle->x[2] >> SUBPIXEL_BITS, y2 = triangle->y[2] >> SUBPIXEL_BITS;
+
+    // draw filled Triangle
+    if (is_render_filled_triangle() && raster_method == RASTER_EDGE){
+        draw_filled_triangle_edge(triangle, clip, window_width, window_height, color_buffer, z_buffer);
+    } else if (is_render_filled_triangle()){
+        draw_filled_triangle(x0, y0, 0, 1.0 / triangle->inv_w[0],
+                             x1, y1, 0, 1.0 / triangle->inv_w[1],
+                             x2, y2, 0, 1.0 / triangle->inv_w[2],
+                             triangle->color, window_width, window_height, color_buffer, z_buffer); // dark gray
+    }
+
+    // draw textured triangle
+    if (is_render_texture() && raster_method == RASTER_EDGE){
+        draw_textured_triangle_edge(triangle, texture_get(triangle->material), clip, window_width, window_height, color_buffer, z_buffer);
+    } else if (is_render_texture()){
+        draw_textured_triangle(
+            x0, y0, 0, 1.0 / triangle->inv_w[0], tex2_unpack(triangle->uv[0]),
+            x1, y1, 0, 1.0 / triangle->inv_w[1], tex2_unpack(triangle->uv[1]),
+            x2, y2, 0, 1.0 / triangle->inv_w[2], tex2_unpack(triangle->uv[2]),
+            texture_get(triangle->material), window_width, window_height, color_buffer, z_buffer);
+    }
+
+    // draw wireframe
+    if (is_render_wireframe()) {
+        draw_triangle_clipped(x0, y0, x1, y1, x2, y2, 0xFFFFFFFF, clip, window_width, window_height, color_buffer);
+    }
+
+    // draw vertex in red
+    if (render_method == RENDER_WIRE_VERTEX){
+        draw_rectangle_clipped(x0, y0, 3, 3, 0xFF0000FF, clip, window_width, window_height, color_buffer);
+        draw_rectangle_clipped(x1, y1, 3, 3, 0xFF0000FF, clip, window_width, window_height, color_buffer);
+        draw_rectangle_clipped(x2, y2, 3, 3, 0xFF0000FF, clip, window_width, window_height, color_buffer);
     }
 }
 
+/**
+ * @brief draws the triangles binned to one tile, in stream order. Runs on
+ *        any raster thread: tiles don't share pixels.
+ *
+ * @param data: triangle stream of the frame
+ *        index: tile
+ * @return
+ */
+static void render_tile(void* data, int index){
+    const screen_triangle_t* triangles = (const screen_triangle_t*)data;
+    const tile_t* tile = get_tile(index);
+    for (int i = 0; i < array_length(tile->triangles); i++){
+        draw_screen_triangle(&triangles[tile->triangles[i]], &tile->rect);
+    }
+}
+
+/**
+ * @brief clear jobs: each one clears a band of TILE_SIZE rows.
+ *
+ * @param data: color to clear the color buffer with
+ *        index: band
+ * @return
+ */
+static void clear_color_job(void* data, int index){
+    color_t color = *(const color_t*)data;
+    int end_row = (index + 1) * TILE_SIZE < window_height ? (index + 1) * TILE_SIZE : window_height;
+    for (int i = index * TILE_SIZE * window_width; i < end_row * window_width; i++){
+        color_buffer[i] = color;
+    }
+}
+
+static void clear_z_job(void* data, int index){
+    int end_row = (index + 1) * TILE_SIZE < window_height ? (index + 1) * TILE_SIZE : window_height;
+    for (int i = index * TILE_SIZE * window_width; i < end_row * window_width; i++){
+        z_buffer[i] = 100.0f; // left-handed, [0.0, 1.0]
+    }
+}
+
+/**
+ * @brief capture job: downscales a band of CAPTURE_BAND_ROWS rows of the
+ *        color buffer into a capture buffer.
+ *
+ * @param data: capture_frame_t*
+ *        index: band
+ * @return
+ */
+static void downscale_capture_job(void* data, int index){
+    int end_row = (index + 1) * CAPTURE_BAND_ROWS < save_height ? (index + 1) * CAPTURE_BAND_ROWS : save_height;
+    capture_downscale_2x((capture_frame_t*)data, color_buffer, window_width, index * CAPTURE_BAND_ROWS, end_row);
+}
+
+/**
+ * @brief frame sink of the export: downscales the finished frame into the
+ *        capture ring, for the encoders to write as image files or a stream.
+ *        Needs set_export(true) before initialize().
+ *
+ * @param pixels: the color buffer, width x height
+ *        user_data: unused
+ * @return
+ */
+void capture_frame_sink(const color_t* pixels, int width, int height, void* user_data){
+    // Skip the first frames by count, not by time, so the same frames are
+    // captured at any frame rate and with a fixed time step.
+    num_rendered_frames++;
+    if (!is_export || num_rendered_frames <= CAPTURE_SKIP_FRAMES || capture_idx >= capture_max){
+        return;
+    }
+    PROFILE_BEGIN(PROF_EXPORT);
+
+    // A free buffer of the capture ring, NULL if the frame is dropped.
+    // Only captured frames are numbered, so the files have no gaps.
+    capture_frame_t* frame = capture_acquire();
+    if (frame != NULL){
+        // Downscale the color buffer into it in bands, the encoders write it
+        job_parallel_for(downscale_capture_job, frame,
+                         (save_height + CAPTURE_BAND_ROWS - 1) / CAPTURE_BAND_ROWS, PROF_EXPORT);
+        frame->index = ++capture_idx;
+        capture_submit(frame);
+    }
+
+    PROFILE_END(PROF_EXPORT);
+}
 
 /**
  * @brief render function in game loop. Note that it is triangle basis.
@@ -442,113 +1136,70 @@ void update(void){
  * @return
  */
 void render(void){
+    PROFILE_BEGIN(PROF_RENDER);
 
-    clear_color_buffer(0xFF000000);
-    clear_z_buffer();
+    // Clear the buffers in bands on the job threads, meanwhile the triangles
+    // are binned. Tiles only start drawing once the clears are done.
+    job_counter_t clears = { 0 };
+    color_t background = 0xFF000000;
+    int num_bands = (window_height + TILE_SIZE - 1) / TILE_SIZE;
+    job_submit(clear_color_job, &background, num_bands, PROF_CLEAR_COLOR, NULL, &clears);
+    job_submit(clear_z_job, NULL, num_bands, PROF_CLEAR_Z, NULL, &clears);
 
-    color_t* color_buffer = get_color_buffer();
     SDL_Texture* color_buffer_texture = get_SDL_Texture();
 
     // draw_grid(0xFFAAAAAA);
 
     // Loop all projected points and render them
-    for (int i = 0; i < get_num_triangles_to_render(); i++) {
-
-        // render all vertex points
-        triangle_t triangle = get_triangle_to_render(i);
-
-        // draw filled Triangle
-        if (is_render_filled_triangle()){
-			draw_filled_triangle(triangle.points[0].x, triangle.points[0].y, triangle.points[0].z, triangle.points[0].w,
-								 triangle.points[1].x, triangle.points[1].y, triangle.points[1].z, triangle.points[1].w,
-								 triangle.points[2].x, triangle.points[2].y, triangle.points[2].z, triangle.points[2].w,
-								 triangle.color, window_width, window_height, color_buffer, z_buffer); // dark gray
+    const screen_triangle_t* triangles = get_triangles_to_render();
+    int num_triangles = get_num_triangles_to_render();
+    if (raster_method == RASTER_EDGE){
+        // Sort the triangles into screen tiles, and rasterize the tiles in parallel
+        PROFILE_BEGIN(PROF_BIN);
+        bin_triangles_to_tiles(triangles, num_triangles);
+        PROFILE_END(PROF_BIN);
+
+        PROFILE_BEGIN(PROF_RASTER);
+        job_counter_t tiles = { 0 };
+        job_submit(render_tile, (void*)triangles, get_num_tiles(), PROF_RASTER, &clears, &tiles);
+        job_wait(&tiles);
+    } else {
+        job_wait(&clears);
+        PROFILE_BEGIN(PROF_RASTER);
+        rect_t viewport = { 0, 0, window_width - 1, window_height - 1 };
+        for (int i = 0; i < num_triangles; i++) {
+            draw_screen_triangle(&triangles[i], &viewport);
         }
+    }
 
-        // draw textured triangle
-        if (is_render_texture()){
-            draw_textured_triangle(
-                triangle.points[0].x, triangle.points[0].y, triangle.points[0].z, triangle.points[0].w, triangle.textcoords[0],
-                triangle.points[1].x, triangle.points[1].y, triangle.points[1].z, triangle.points[1].w, triangle.textcoords[1],
-                triangle.points[2].x, triangle.points[2].y, triangle.points[2].z, triangle.points[2].w, triangle.textcoords[2],
-                triangle.texture, window_width, window_height, color_buffer, z_buffer);
-        }
+    PROFILE_END(PROF_RASTER);
 
-        // draw wireframe
-        if (is_render_wireframe()) {
-            draw_triangle(triangle.points[0].x, triangle.points[0].y,
-                          triangle.points[1].x, triangle.points[1].y,
-                          triangle.points[2].x, triangle.points[2].y, 0xFFFFFFFF, window_width, window_height, color_buffer);
-        }
+    // Hand the finished frame to the sink, if any, e.g. capture_frame_sink().
+    if (frame_sink != NULL){
+        frame_sink(color_buffer, window_width, window_height, frame_sink_data);
+    }
 
-        // draw vertex in red
-        if (render_method == RENDER_WIRE_VERTEX){
-            draw_rectangle(triangle.points[0].x, triangle.points[0].y, 3, 3, 0xFF0000FF, window_width, window_height, color_buffer);
-            draw_rectangle(triangle.points[1].x, triangle.points[1].y, 3, 3, 0xFF0000FF, window_width, window_height, color_buffer);
-            draw_rectangle(triangle.points[2].x, triangle.points[2].y, 3, 3, 0xFF0000FF, window_width, window_height, color_buffer);
-        }
+    // Headless: there is no texture, renderer or window to present to.
+    if (is_headless){
+        PROFILE_END(PROF_RENDER);
+        return;
     }
 
     // render_color_buffer();
     // color buffer -> color buffer texture
+    PROFILE_BEGIN(PROF_TEXTURE_UPLOAD);
     SDL_UpdateTexture(
         color_buffer_texture,
         NULL,
         color_buffer,
         (int)(get_window_width()*sizeof(color_t))
     );
+    PROFILE_END(PROF_TEXTURE_UPLOAD);
 
-    // Export in PNG
-    if (is_export && SDL_GetTicks() > 3000 && capture_idx < capture_max){
-
-        // Render full-res texture into small_rt at half size
-        SDL_SetRenderTarget(renderer, save_texture);
-        SDL_RenderClear(renderer);
-        SDL_Rect dst = {0, 0, save_width, save_height};
-        SDL_RenderCopy(renderer, color_buffer_texture, NULL, &dst);
-        SDL_RenderFlush(renderer);
-
-        // Read pixels from renderer: renderer -> save_pixels
-        if (SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888, save_pixels, save_pitch) != 0) {
-            fprintf(stderr, "SDL_RenderReadPixels failed: %s\n", SDL_GetError());
-            return;
-        }
-
-        // Wrap pixel data in SDL_Surface
-        save_surface = SDL_CreateRGBSurfaceFrom(save_pixels,
-                                                save_width,
-                                                save_height,
-                                                32,
-                                                save_pitch,
-                                                0x00FF0000, // R
-                                                0x0000FF00, // G
-                                                0x000000FF, // B
-                                                0xFF000000  // A
-        );
-
-        if (!save_surface) {
-            fprintf(stderr, "SDL_CreateRGBSurfaceFrom failed: %s\n", SDL_GetError());
-            return;
-        }
-
-        // Save to PNG
-        char path[256];
-        snprintf(path, sizeof(path), "../captures/frame_%04d.png", ++capture_idx);
-        if (IMG_SavePNG(save_surface, path) == 0){
-            printf("[cap] %s\n", path);
-        }else{
-            fprintf(stderr, "IMG_SavePNG failed: %s\n", SDL_GetError());
-        }
-
-        // Restore render target back to window
-        SDL_SetRenderTarget(renderer, NULL);
-
-        // Free save_surface
-        SDL_FreeSurface(save_surface);
-    }
     // color buffer texture -> display texture
     SDL_RenderCopy(renderer, color_buffer_texture, NULL, NULL);
     SDL_RenderPresent(renderer); // Displays the result on the window.
+    PROFILE_END(PROF_RENDER);
 }
 ////////////////////////////////////////////////////////////////////////////////
 // render options
@@ -576,19 +1227,40 @@ bool is_render_wireframe(void){
  * @return
  */
 void destroy_display(void){
-    if (save_pixels != NULL){
-        free(save_pixels);
+    job_wait(&geometry_jobs);
+    capture_shutdown();
+    stream_close();
+    job_shutdown();
+
+    capture_stats_t capture = capture_get_stats();
+    if (capture.frames_submitted > 0 || capture.frames_dropped > 0){
+        printf("[cap] %d written, %d failed, %d dropped (%s), %d buffers, queue depth max %d mean %.2f, "
+               "encode %.2f ms mean %.2f ms max, blocked %.2f ms\n",
+               capture.frames_written, capture.frames_failed, capture.frames_dropped,
+               capture_policy_name(capture_policy), capture.num_buffers,
+               capture.max_queue_depth, capture.mean_queue_depth,
+               capture.encode_ms_mean, capture.encode_ms_max, capture.blocked_ms);
+    }
+    free_tiles();
+    for (int i = 0; i < array_length(geometry_chunks); i++){
+        array_free(geometry_chunks[i].triangles);
     }
+    array_free(geometry_chunks);
+    geometry_chunks = NULL;
+    num_geometry_chunks = 0;
+    array_free(mesh_frustum_results);
+    mesh_frustum_results = NULL;
     if (color_buffer != NULL){
         free(color_buffer);
     }
     if (z_buffer != NULL){
         free(z_buffer);
     }
-    SDL_DestroyTexture(color_buffer_texture);
-    SDL_DestroyTexture(save_texture);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
+    if (!is_headless){
+        SDL_DestroyTexture(color_buffer_texture);
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+    }
     SDL_Quit(); // reverse of init.
 }
 
@@ -624,13 +1296,3 @@ void flip_pixels_vertically(Uint8* pixels, int width, int height, int pitch) {
     }
     free(temp_row);
 }
-
-/**
- * @brief frees color buffer, destroys the SDL window and its renderer.
- *
- * @param
- * @return
- */
-void destroy_save(void){
-    SDL_DestroyTexture(save_texture);
-}
@@ -1,10 +1,13 @@
+#include "draw.h"
 #include "color.h"
 #include "vector.h"
 #include "texture.h"
 #include "util.h"
 #include <stdlib.h>
+#include <stdbool.h>
 #include <math.h>
 #include "upng.h"
+#include "profiler.h"
 
 /**
  * @brief draws a pixel
@@ -30,6 +33,19 @@ void draw_pixel(int x, int y, color_t color, int window_width, int window_height
     color_buffer[window_width*y + x] = color;
 }
 
+/**
+ * @brief draws a pixel, when it is inside of the clip rectangle.
+ *
+ * @param clip: rectangle within the color buffer
+ * @return
+ */
+static void draw_pixel_clipped(int x, int y, color_t color, const rect_t* clip, int window_width, color_t* color_buffer){
+    if (x < clip->x_min || x > clip->x_max || y < clip->y_min || y > clip->y_max){
+        return;
+    }
+    color_buffer[window_width*y + x] = color;
+}
+
 /// Exercise: Draw a background grid that fills the entire window. Lines should be rendered at every row/col multiple of 10.
 /**
  * @brief draws a background grid
@@ -68,6 +84,47 @@ void draw_grid(color_t color, int window_width, int window_height, color_t* colo
  * @return
  */
 void draw_line(int x0, int y0, int x1, int y1, color_t color, int window_width, int window_height, color_t* color_buffer){
+    rect_t viewport = { 0, 0, window_width - 1, window_height - 1 };
+    draw_line_clipped(x0, y0, x1, y1, color, &viewport, window_width, color_buffer);
+}
+
+/**
+ * @brief narrows the steps [i_first, i_last] of a line to the ones whose
+ *        coordinate start + i * inc may round into [min, max]. Conservative
+ *        by a step, the pixels are clipped exactly when drawn.
+ *
+ * @return returns false, when no step is left.
+ */
+static bool clip_line_steps(int start, float inc, int min, int max, int* i_first, int* i_last){
+    if (inc == 0){
+        return start >= min && start <= max && *i_first <= *i_last;
+    }
+    float t0 = (min - 0.5f - start) / inc;
+    float t1 = (max + 0.5f - start) / inc;
+    if (t0 > t1){
+        float t = t0; t0 = t1; t1 = t;
+    }
+    // Clamp in float first, the steps of an off-screen line can exceed int
+    float first = floorf(t0) - 1;
+    float last = ceilf(t1) + 1;
+    if (first > *i_first){
+        *i_first = first > *i_last ? *i_last + 1 : (int)first;
+    }
+    if (last < *i_last){
+        *i_last = last < *i_first ? *i_first - 1 : (int)last;
+    }
+    return *i_first <= *i_last;
+}
+
+/**
+ * @brief draws the pixels of a line that are inside of the clip rectangle.
+ *        Every pixel is the same as the one draw_line() draws, so a line can
+ *        be drawn in pieces, one per screen tile.
+ *
+ * @param clip: rectangle within the color buffer
+ * @return
+ */
+void draw_line_clipped(int x0, int y0, int x1, int y1, color_t color, const rect_t* clip, int window_width, color_t* color_buffer){
     int delta_x = (x1 - x0);
     int delta_y = (y1 - y0);
 
@@ -77,13 +134,20 @@ void draw_line(int x0, int y0, int x1, int y1, color_t color, int window_width,
     float x_inc = delta_x / (float)side_length;
     float y_inc = delta_y / (float)side_length;
 
-    float current_x = x0;
-    float current_y = y0;
+    // Only walk the steps that can land in the clip rectangle, a tile crossed
+    // by a long line shouldn't pay for all of it. Each step is computed from
+    // the start, not accumulated, so it is the same wherever the walk begins.
+    int i_first = 0;
+    int i_last = side_length;
+    if (!clip_line_steps(x0, x_inc, clip->x_min, clip->x_max, &i_first, &i_last) ||
+        !clip_line_steps(y0, y_inc, clip->y_min, clip->y_max, &i_first, &i_last)){
+        return;
+    }
 
-    for (int i = 0; i <= side_length; i++){
-        draw_pixel(round(current_x), round(current_y), color, window_width, window_height, color_buffer);
-        current_x += x_inc;
-        current_y += y_inc;
+    for (int i = i_first; i <= i_last; i++){
+        float current_x = x0 + i * x_inc;
+        float current_y = y0 + i * y_inc;
+        draw_pixel_clipped(round(current_x), round(current_y), color, clip, window_width, color_buffer);
     }
 }
 
@@ -100,6 +164,19 @@ void draw_line(int x0, int y0, int x1, int y1, color_t color, int window_width,
 * @return
 */
 void draw_rectangle(int x, int y, int w, int h, color_t color, int window_width, int window_height, color_t* color_buffer){
+    rect_t viewport = { 0, 0, window_width - 1, window_height - 1 };
+    draw_rectangle_clipped(x, y, w, h, color, &viewport, window_width, window_height, color_buffer);
+}
+
+/**
+ * @brief draws the pixels of a rectangle that are inside of the clip
+ *        rectangle, see draw_rectangle().
+ *
+ * @param clip: rectangle within the color buffer
+ * @return
+ */
+void draw_rectangle_clipped(int x, int y, int w, int h, color_t color, const rect_t* clip,
+                            int window_width, int window_height, color_t* color_buffer){
 
     // check arguments
     if (x < 0 || x >= window_width) {
@@ -125,7 +202,7 @@ void draw_rectangle(int x, int y, int w, int h, color_t color, int window_width,
     for(int j = 0; j < h; j++){
         for (int i = 0; i < w; i++){
             if ((y + j) < window_height && (x + i) < window_width){
-                draw_pixel(x+i, y+j, color, window_width, window_height, color_buffer); // use draw_pixel()!
+                draw_pixel_clipped(x+i, y+j, color, clip, window_width, color_buffer);
             }
         }
     }
@@ -214,8 +291,11 @@ void draw_texel(int x, int y,
     interpolated_reciprocal_w = 1.0 - interpolated_reciprocal_w;
     /* interpolated_reciprocal_w = 1/interpolated_reciprocal_w; */
 
+    PROFILE_COUNT(PROF_PIXELS_TESTED, 1);
+
     // Only draw the pixel if the depth value is less than the one previously stored in the z-buffer.
     if (interpolated_reciprocal_w < z_buffer[(window_width * y) + x]){
+        PROFILE_COUNT(PROF_PIXELS_WRITTEN, 1);
 
         // Get the buffer of colors from the texture
         uint32_t* texture_buffer = (uint32_t*)upng_get_buffer(texture);
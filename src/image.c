@@ -0,0 +1,231 @@
+#include "image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// QOI: a 14 byte header, then one op per pixel or per run of equal pixels,
+// then 7 zero bytes and a one. The ops reference the previous pixel, or one
+// of 64 recently seen pixels, indexed by a hash of the color.
+////////////////////////////////////////////////////////////////////////////////
+#define QOI_OP_INDEX 0x00 // 00xxxxxx: pixel from the index
+#define QOI_OP_DIFF  0x40 // 01rrggbb: r, g, b differ from the previous by -2..1
+#define QOI_OP_LUMA  0x80 // 10gggggg rrrrbbbb: g by -32..31, r and b by -8..7 more than g
+#define QOI_OP_RUN   0xC0 // 11xxxxxx: previous pixel repeated 1..62 times
+#define QOI_OP_RGB   0xFE
+#define QOI_OP_RGBA  0xFF
+#define QOI_HEADER_SIZE 14
+#define QOI_PADDING_SIZE 8
+
+typedef struct {
+    uint8_t r, g, b, a;
+} qoi_pixel_t;
+
+static int qoi_hash(qoi_pixel_t p){
+    return (p.r * 3 + p.g * 5 + p.b * 7 + p.a * 11) % 64;
+}
+
+static bool qoi_equal(qoi_pixel_t p, qoi_pixel_t q){
+    return p.r == q.r && p.g == q.g && p.b == q.b && p.a == q.a;
+}
+
+static uint8_t* write_u32_be(uint8_t* out, uint32_t value){
+    out[0] = (uint8_t)(value >> 24);
+    out[1] = (uint8_t)(value >> 16);
+    out[2] = (uint8_t)(value >> 8);
+    out[3] = (uint8_t)value;
+    return out + 4;
+}
+
+/**
+ * @brief returns the largest size qoi_encode() can produce: a header, 5 bytes
+ *        per pixel at worst, and the end marker.
+ */
+size_t qoi_max_size(int width, int height){
+    return QOI_HEADER_SIZE + (size_t)width * height * 5 + QOI_PADDING_SIZE;
+}
+
+/**
+ * @brief encodes RGBA pixels as QOI, 4 channels, sRGB.
+ *
+ * @param
+ *      rgba  : pixels, byte order R, G, B, A
+ *      width, height : image size in pixels
+ *      pitch : bytes per row
+ *      out   : at least qoi_max_size() bytes
+ * @return returns the size of the encoded image in bytes.
+ */
+size_t qoi_encode(const uint8_t* rgba, int width, int height, int pitch, uint8_t* out){
+    uint8_t* p = out;
+    memcpy(p, "qoif", 4);
+    p = write_u32_be(p + 4, (uint32_t)width);
+    p = write_u32_be(p, (uint32_t)height);
+    *p++ = 4; // channels
+    *p++ = 0; // sRGB with linear alpha
+
+    qoi_pixel_t index[64];
+    memset(index, 0, sizeof(index));
+    qoi_pixel_t previous = { 0, 0, 0, 255 };
+    int run = 0;
+
+    for (int y = 0; y < height; y++){
+        const uint8_t* row = rgba + (size_t)y * pitch;
+        for (int x = 0; x < width; x++){
+            qoi_pixel_t pixel = { row[4 * x], row[4 * x + 1], row[4 * x + 2], row[4 * x + 3] };
+
+            if (qoi_equal(pixel, previous)){
+                run++;
+                if (run == 62){
+                    *p++ = QOI_OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0){
+                *p++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+
+            int hash = qoi_hash(pixel);
+            if (qoi_equal(index[hash], pixel)){
+                *p++ = QOI_OP_INDEX | hash;
+            }else{
+                index[hash] = pixel;
+                if (pixel.a == previous.a){
+                    // wrap around like the decoder, in 8 bit
+                    int dr = (int8_t)(uint8_t)(pixel.r - previous.r);
+                    int dg = (int8_t)(uint8_t)(pixel.g - previous.g);
+                    int db = (int8_t)(uint8_t)(pixel.b - previous.b);
+                    int dr_dg = dr - dg;
+                    int db_dg = db - dg;
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1){
+                        *p++ = QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+                    }else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7){
+                        *p++ = QOI_OP_LUMA | (dg + 32);
+                        *p++ = (uint8_t)((dr_dg + 8) << 4 | (db_dg + 8));
+                    }else{
+                        *p++ = QOI_OP_RGB;
+                        *p++ = pixel.r;
+                        *p++ = pixel.g;
+                        *p++ = pixel.b;
+                    }
+                }else{
+                    *p++ = QOI_OP_RGBA;
+                    *p++ = pixel.r;
+                    *p++ = pixel.g;
+                    *p++ = pixel.b;
+                    *p++ = pixel.a;
+                }
+            }
+            previous = pixel;
+        }
+    }
+    if (run > 0){
+        *p++ = QOI_OP_RUN | (run - 1);
+    }
+
+    memset(p, 0, QOI_PADDING_SIZE - 1);
+    p[QOI_PADDING_SIZE - 1] = 1;
+    return (size_t)(p - out) + QOI_PADDING_SIZE;
+}
+
+static bool write_png(const char* path, const uint8_t* rgba, int width, int height, int pitch){
+
+    // Wrap pixel data in SDL_Surface
+    SDL_Surface* surface = SDL_CreateRGBSurfaceFrom((void*)rgba,
+                                                    width,
+                                                    height,
+                                                    32,
+                                                    pitch,
+                                                    0x000000FF, // R
+                                                    0x0000FF00, // G
+                                                    0x00FF0000, // B
+                                                    0xFF000000  // A
+    );
+
+    if (!surface) {
+        fprintf(stderr, "SDL_CreateRGBSurfaceFrom failed: %s\n", SDL_GetError());
+        return false;
+    }
+
+    bool is_saved = IMG_SavePNG(surface, path) == 0;
+    if (!is_saved){
+        fprintf(stderr, "IMG_SavePNG failed: %s\n", SDL_GetError());
+    }
+    SDL_FreeSurface(surface);
+    return is_saved;
+}
+
+static bool write_qoi(FILE* file, const uint8_t* rgba, int width, int height, int pitch){
+    uint8_t* encoded = (uint8_t*)malloc(qoi_max_size(width, height));
+    if (encoded == NULL){
+        return false;
+    }
+    size_t size = qoi_encode(rgba, width, height, pitch, encoded);
+    bool is_written = fwrite(encoded, 1, size, file) == size;
+    free(encoded);
+    return is_written;
+}
+
+static bool write_ppm(FILE* file, const uint8_t* rgba, int width, int height, int pitch){
+    uint8_t* row = (uint8_t*)malloc((size_t)width * 3);
+    if (row == NULL){
+        return false;
+    }
+    bool is_written = fprintf(file, "P6\n%d %d\n255\n", width, height) > 0;
+    for (int y = 0; y < height && is_written; y++){
+        const uint8_t* src = rgba + (size_t)y * pitch;
+        for (int x = 0; x < width; x++){
+            row[3 * x] = src[4 * x];
+            row[3 * x + 1] = src[4 * x + 1];
+            row[3 * x + 2] = src[4 * x + 2];
+        }
+        is_written = fwrite(row, 3, width, file) == (size_t)width;
+    }
+    free(row);
+    return is_written;
+}
+
+/**
+ * @brief writes RGBA pixels to an image file. PPM drops the alpha channel.
+ *
+ * @param
+ *      path   : file to write
+ *      format : one of enum image_format
+ *      rgba   : pixels, byte order R, G, B, A
+ *      width, height : image size in pixels
+ *      pitch  : bytes per row
+ * @return returns false, when the file could not be written.
+ */
+bool image_write(const char* path, int format, const uint8_t* rgba, int width, int height, int pitch){
+    if (format == IMAGE_PNG){
+        return write_png(path, rgba, width, height, pitch);
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL){
+        perror("Failed to open the image file");
+        return false;
+    }
+    bool is_written = format == IMAGE_QOI ? write_qoi(file, rgba, width, height, pitch)
+                                          : write_ppm(file, rgba, width, height, pitch);
+    // fclose() flushes, it may fail as well
+    is_written = fclose(file) == 0 && is_written;
+    if (!is_written){
+        fprintf(stderr, "Failed to write %s\n", path);
+    }
+    return is_written;
+}
+
+const char* image_format_extension(int format){
+    switch (format){
+    case IMAGE_QOI:
+        return "qoi";
+    case IMAGE_PPM:
+        return "ppm";
+    default:
+        return "png";
+    }
+}
@@ -0,0 +1,392 @@
+#define _POSIX_C_SOURCE 200809L // sysconf() in -std=c99
+#include "job.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "profiler.h"
+
+#define MAX_THREADS 64
+#define QUEUE_INITIAL_CAPACITY 256 // jobs, power of two
+
+typedef struct {
+    job_func_t func;
+    void* data;
+    int index;
+    int stage;              // profiler stage the job is timed in
+    job_counter_t* counter; // decremented when the job is done, or NULL
+} job_t;
+
+// Jobs submitted with a dependency, until their dependency's counter is zero
+struct job_waiting {
+    job_func_t func;
+    void* data;
+    int count;
+    int stage;
+    job_counter_t* counter;
+    job_waiting_t* next;
+};
+
+// Growable ring of jobs. The owner takes from the back, thieves from the front.
+// Guarded by a lock: deques are touched once per job, not per pixel.
+typedef struct {
+    pthread_mutex_t lock;
+    job_t* jobs;
+    int capacity; // power of two
+    int head;     // index of the front job
+    int count;
+} job_queue_t;
+
+static pthread_t workers[MAX_THREADS];
+static job_queue_t deques[MAX_THREADS]; // one per worker, [0] is unused
+static job_queue_t injection_queue;     // jobs from threads that aren't workers
+static int num_threads = 1;             // workers + the main thread
+static int num_queued = 0;              // jobs in all queues, atomic
+
+// Sleeping threads wait for new jobs or finished counters
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static bool is_shutdown = false;
+
+static __thread int thread_index = 0; // 0: the main thread, or any non-worker
+
+////////////////////////////////////////////////////////////////////////////////
+// Queues
+////////////////////////////////////////////////////////////////////////////////
+static bool queue_init(job_queue_t* queue){
+    pthread_mutex_init(&queue->lock, NULL);
+    queue->jobs = (job_t*)malloc(sizeof(job_t) * QUEUE_INITIAL_CAPACITY);
+    queue->capacity = QUEUE_INITIAL_CAPACITY;
+    queue->head = 0;
+    queue->count = 0;
+    return queue->jobs != NULL;
+}
+
+static void queue_free(job_queue_t* queue){
+    free(queue->jobs);
+    queue->jobs = NULL;
+    pthread_mutex_destroy(&queue->lock);
+}
+
+// Pushes a job at the back, growing the ring when full. Caller holds the lock.
+static void queue_push_locked(job_queue_t* queue, const job_t* job){
+    if (queue->count == queue->capacity){
+        // Unroll the ring into a twice as large one
+        job_t* jobs = (job_t*)malloc(sizeof(job_t) * queue->capacity * 2);
+        if (jobs == NULL){
+            fprintf(stderr, "Failed to grow a job queue.\n");
+            abort();
+        }
+        for (int i = 0; i < queue->count; i++){
+            jobs[i] = queue->jobs[(queue->head + i) & (queue->capacity - 1)];
+        }
+        free(queue->jobs);
+        queue->jobs = jobs;
+        queue->capacity *= 2;
+        queue->head = 0;
+    }
+    queue->jobs[(queue->head + queue->count) & (queue->capacity - 1)] = *job;
+    queue->count++;
+}
+
+static bool queue_pop_back(job_queue_t* queue, job_t* job){
+    pthread_mutex_lock(&queue->lock);
+    bool is_found = queue->count > 0;
+    if (is_found){
+        queue->count--;
+        *job = queue->jobs[(queue->head + queue->count) & (queue->capacity - 1)];
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return is_found;
+}
+
+static bool queue_pop_front(job_queue_t* queue, job_t* job){
+    pthread_mutex_lock(&queue->lock);
+    bool is_found = queue->count > 0;
+    if (is_found){
+        *job = queue->jobs[queue->head];
+        queue->head = (queue->head + 1) & (queue->capacity - 1);
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return is_found;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scheduling
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @brief queues count jobs func(data, 0..count-1): on the deque of the
+ *        calling worker, or on the injection queue, and wakes the sleepers.
+ */
+static void push_jobs(job_func_t func, void* data, int count, int stage, job_counter_t* counter){
+    job_queue_t* queue = thread_index > 0 ? &deques[thread_index] : &injection_queue;
+
+    // A worker pops its own deque from the back, push in reverse so that
+    // index 0 runs first, like on the injection queue.
+    pthread_mutex_lock(&queue->lock);
+    for (int i = 0; i < count; i++){
+        int index = thread_index > 0 ? count - 1 - i : i;
+        job_t job = { func, data, index, stage, counter };
+        queue_push_locked(queue, &job);
+    }
+    __atomic_add_fetch(&num_queued, count, __ATOMIC_RELEASE); // before any of them can be taken
+    pthread_mutex_unlock(&queue->lock);
+
+    pthread_mutex_lock(&mutex);
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * @brief takes the next job for the calling thread: the newest job of its own
+ *        deque, the oldest of the injection queue, or the oldest job stolen
+ *        from another worker.
+ */
+static bool find_job(job_t* job){
+    if (__atomic_load_n(&num_queued, __ATOMIC_ACQUIRE) == 0){
+        return false;
+    }
+    bool is_found = (thread_index > 0 && queue_pop_back(&deques[thread_index], job)) ||
+                    queue_pop_front(&injection_queue, job);
+    for (int i = 1; !is_found && i < num_threads; i++){
+        int victim = (thread_index + i) % num_threads;
+        if (victim != 0 && queue_pop_front(&deques[victim], job)){
+            is_found = true;
+            PROFILE_COUNT(PROF_JOBS_STOLEN, 1);
+        }
+    }
+    if (is_found){
+        __atomic_sub_fetch(&num_queued, 1, __ATOMIC_RELAXED);
+    }
+    return is_found;
+}
+
+/**
+ * @brief counts a job of a counter as done. The last one wakes the waiters
+ *        and releases the jobs that depend on the counter.
+ */
+static void finish_job(job_counter_t* counter){
+    if (counter == NULL){
+        return;
+    }
+
+    // Under the mutex, so that job_wait() can't return and drop the counter
+    // while it is still being touched here
+    job_waiting_t* waiting = NULL;
+    pthread_mutex_lock(&mutex);
+    if (__atomic_sub_fetch(&counter->pending, 1, __ATOMIC_ACQ_REL) == 0){
+        waiting = counter->waiting;
+        counter->waiting = NULL;
+        pthread_cond_broadcast(&wake);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    while (waiting != NULL){
+        job_waiting_t* next = waiting->next;
+        push_jobs(waiting->func, waiting->data, waiting->count, waiting->stage, waiting->counter);
+        free(waiting);
+        waiting = next;
+    }
+}
+
+static void run_job(const job_t* job){
+    PROFILE_JOB_BEGIN(job->stage);
+    job->func(job->data, job->index);
+    PROFILE_COUNT(PROF_JOBS_RUN, 1);
+    PROFILE_JOB_END(job->stage); // after the counts of the job, see profiler_count()
+    finish_job(job->counter);
+}
+
+static void* worker_main(void* arg){
+    thread_index = (int)(intptr_t)arg;
+
+    for (;;){
+        job_t job;
+        if (find_job(&job)){
+            run_job(&job);
+            continue;
+        }
+
+        pthread_mutex_lock(&mutex);
+        while (__atomic_load_n(&num_queued, __ATOMIC_ACQUIRE) == 0 && !is_shutdown){
+            pthread_cond_wait(&wake, &mutex);
+        }
+        bool is_done = is_shutdown;
+        pthread_mutex_unlock(&mutex);
+        if (is_done){
+            return NULL;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Interface
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @brief starts the worker threads.
+ *
+ * @param num: number of threads that run jobs, including the calling thread,
+ *             or <= 0 for one per CPU
+ * @return returns false, when no worker could be started (jobs then run on
+ *         the calling thread).
+ */
+bool job_init(int num){
+    job_shutdown();
+
+    if (num <= 0){
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num = cpus > 0 ? (int)cpus : 1;
+    }
+    if (num > MAX_THREADS){
+        num = MAX_THREADS;
+    }
+
+    if (!queue_init(&injection_queue)){
+        return false;
+    }
+    for (num_threads = 1; num_threads < num; num_threads++){
+        if (!queue_init(&deques[num_threads])){
+            break;
+        }
+        if (pthread_create(&workers[num_threads], NULL, worker_main, (void*)(intptr_t)num_threads) != 0){
+            queue_free(&deques[num_threads]);
+            break;
+        }
+    }
+    if (num_threads < num){
+        fprintf(stderr, "Failed to start worker thread %d.\n", num_threads);
+        return num_threads > 1;
+    }
+    return true;
+}
+
+/**
+ * @brief stops and joins the worker threads. Jobs must be waited for first.
+ */
+void job_shutdown(void){
+    pthread_mutex_lock(&mutex);
+    is_shutdown = true;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&mutex);
+
+    for (int i = 1; i < num_threads; i++){
+        pthread_join(workers[i], NULL);
+        queue_free(&deques[i]);
+    }
+    if (injection_queue.jobs != NULL){
+        queue_free(&injection_queue);
+    }
+    num_threads = 1;
+    is_shutdown = false;
+}
+
+int job_num_threads(void){
+    return num_threads;
+}
+
+// 0 on the main thread, 1 .. job_num_threads() - 1 on the workers
+int job_thread_index(void){
+    return thread_index;
+}
+
+bool job_is_worker_thread(void){
+    return thread_index > 0;
+}
+
+/**
+ * @brief submits count jobs func(data, index) for index in [0, count).
+ *
+ * @param func: job, called concurrently
+ *        data: passed to every call
+ *        count: number of jobs
+ *        stage: profiler stage the jobs are timed in
+ *        dependency: the jobs start once its jobs are done, or NULL
+ *        counter: counts the jobs until they are done, or NULL
+ * @return
+ */
+void job_submit(job_func_t func, void* data, int count, int stage,
+                job_counter_t* dependency, job_counter_t* counter){
+    if (count <= 0){
+        return;
+    }
+    if (counter != NULL){
+        __atomic_add_fetch(&counter->pending, count, __ATOMIC_RELAXED);
+    }
+
+    // Without workers nobody else would run them
+    if (num_threads == 1 && dependency == NULL){
+        for (int i = 0; i < count; i++){
+            job_t job = { func, data, i, stage, counter };
+            run_job(&job);
+        }
+        return;
+    }
+
+    if (dependency != NULL){
+        pthread_mutex_lock(&mutex);
+        bool is_pending = __atomic_load_n(&dependency->pending, __ATOMIC_ACQUIRE) > 0;
+        if (is_pending){
+            job_waiting_t* waiting = (job_waiting_t*)malloc(sizeof(job_waiting_t));
+            if (waiting == NULL){
+                fprintf(stderr, "Failed to allocate a job dependency.\n");
+                abort();
+            }
+            *waiting = (job_waiting_t){ func, data, count, stage, counter, dependency->waiting };
+            dependency->waiting = waiting;
+        }
+        pthread_mutex_unlock(&mutex);
+        if (is_pending){
+            return;
+        }
+    }
+    push_jobs(func, data, count, stage, counter);
+}
+
+/**
+ * @brief runs jobs until every job of the counter is done.
+ *
+ * @param counter
+ * @return
+ */
+void job_wait(job_counter_t* counter){
+    for (;;){
+        if (__atomic_load_n(&counter->pending, __ATOMIC_ACQUIRE) == 0){
+            break;
+        }
+        job_t job;
+        if (find_job(&job)){
+            run_job(&job);
+            continue;
+        }
+
+        // The missing jobs run on other threads
+        pthread_mutex_lock(&mutex);
+        while (__atomic_load_n(&counter->pending, __ATOMIC_ACQUIRE) > 0 &&
+               __atomic_load_n(&num_queued, __ATOMIC_ACQUIRE) == 0){
+            pthread_cond_wait(&wake, &mutex);
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+
+    // The last job may still hold the mutex in finish_job()
+    pthread_mutex_lock(&mutex);
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * @brief runs func(data, index) for every index in [0, count) on all threads
+ *        and waits until all of them returned.
+ *
+ * @param func: job, called concurrently
+ *        data: passed to every call
+ *        count: number of indices
+ *        stage: profiler stage the jobs are timed in
+ * @return
+ */
+void job_parallel_for(job_func_t func, void* data, int count, int stage){
+    job_counter_t counter = { 0 };
+    job_submit(func, data, count, stage, NULL, &counter);
+    job_wait(&counter);
+}
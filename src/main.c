@@ -1,8 +1,15 @@
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <SDL2/SDL.h>
 #include "display.h"
 #include "mesh.h"
 #include "camera.h"
+#include "profiler.h"
+#include "capture.h"
+#include "stream.h"
+#include "image.h"
 
 static bool is_running = true;
 
@@ -47,6 +54,24 @@ void process_input(void){
       } else if (event.key.keysym.sym == SDLK_f) {
         // f Disables the back-face culling
         set_cull_method(CULL_NONE);
+      } else if (event.key.keysym.sym == SDLK_g) {
+        // g Enables guard-band clipping
+        set_clip_method(CLIP_GUARD_BAND);
+      } else if (event.key.keysym.sym == SDLK_c) {
+        // c Clips against the full frustum
+        set_clip_method(CLIP_FRUSTUM);
+      } else if (event.key.keysym.sym == SDLK_h) {
+        // h Clips in homogeneous clip space after the combined MVP
+        set_pipeline_method(PIPELINE_CLIP_SPACE);
+      } else if (event.key.keysym.sym == SDLK_v) {
+        // v Clips in camera (view) space, then projects
+        set_pipeline_method(PIPELINE_CAMERA_SPACE);
+      } else if (event.key.keysym.sym == SDLK_e) {
+        // e Rasterizes with edge functions
+        set_raster_method(RASTER_EDGE);
+      } else if (event.key.keysym.sym == SDLK_l) {
+        // l Rasterizes with scanlines
+        set_raster_method(RASTER_SCANLINE);
       } else if (event.key.keysym.sym == SDLK_d) { // Rotation
         // d rotate camera yaw +
         rotate_camera_yaw(get_delta_time());
@@ -91,6 +116,95 @@ void process_input(void){
  */
 void free_resources(void){
     free_mesh();
+    free_triangles_to_render();
+}
+
+/**
+ * @brief parses the command line options
+ *        --headless WIDTHxHEIGHT : render offscreen without any window
+ *        --frames N              : stop after N frames (0: run until quit),
+ *                                  required with --headless, which has no
+ *                                  window to quit
+ *        --trace FILE            : write a Chrome trace (needs `make profile`)
+ *        --pipelined             : overlap the geometry of the next frame with
+ *                                  rasterizing the current one
+ *        --capture-policy P      : block, drop or grow, when every capture
+ *                                  buffer is still being written
+ *        --capture-format F      : png, qoi or ppm files in captures/
+ *        --stream y4m|rgba FILE  : write the captures as one video stream
+ *                                  instead of PNGs, FILE "-" for stdout
+ *
+ * @param
+ * @return returns false on an unknown or malformed option, or --headless
+ *         without --frames.
+ */
+bool parse_args(int argc, char *argv[], int* max_frames, char** trace_path, bool* is_pipelined){
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+      int width = 0;
+      int height = 0;
+      if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+        fprintf(stderr, "--headless expects WIDTHxHEIGHT, e.g. 640x360\n");
+        return false;
+      }
+      set_headless(true);
+      set_resolution(width, height);
+    } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      *max_frames = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      *trace_path = argv[++i];
+#ifndef PROFILE
+      fprintf(stderr, "--trace ignored: build with `make profile` to enable the profiler\n");
+#endif
+    } else if (strcmp(argv[i], "--pipelined") == 0) {
+      *is_pipelined = true;
+    } else if (strcmp(argv[i], "--capture-policy") == 0 && i + 1 < argc) {
+      const char* policy = argv[++i];
+      if (strcmp(policy, "block") == 0) {
+        set_capture_policy(CAPTURE_BLOCK);
+      } else if (strcmp(policy, "drop") == 0) {
+        set_capture_policy(CAPTURE_DROP);
+      } else if (strcmp(policy, "grow") == 0) {
+        set_capture_policy(CAPTURE_GROW);
+      } else {
+        fprintf(stderr, "--capture-policy expects block, drop or grow\n");
+        return false;
+      }
+    } else if (strcmp(argv[i], "--capture-format") == 0 && i + 1 < argc) {
+      const char* format = argv[++i];
+      if (strcmp(format, "png") == 0) {
+        set_capture_format(IMAGE_PNG);
+      } else if (strcmp(format, "qoi") == 0) {
+        set_capture_format(IMAGE_QOI);
+      } else if (strcmp(format, "ppm") == 0) {
+        set_capture_format(IMAGE_PPM);
+      } else {
+        fprintf(stderr, "--capture-format expects png, qoi or ppm\n");
+        return false;
+      }
+    } else if (strcmp(argv[i], "--stream") == 0 && i + 2 < argc) {
+      const char* format = argv[++i];
+      if (strcmp(format, "y4m") == 0) {
+        set_capture_stream(STREAM_Y4M, argv[++i]);
+      } else if (strcmp(format, "rgba") == 0) {
+        set_capture_stream(STREAM_RGBA, argv[++i]);
+      } else {
+        fprintf(stderr, "--stream expects y4m or rgba, then a file or -\n");
+        return false;
+      }
+    } else {
+      fprintf(stderr, "usage: %s [--headless WIDTHxHEIGHT] [--frames N] [--trace FILE] [--pipelined]"
+                      " [--capture-policy block|drop|grow]"
+                      " [--capture-format png|qoi|ppm] [--stream y4m|rgba FILE]\n", argv[0]);
+      return false;
+    }
+  }
+  // Headless runs take no input, only the frame count ends them
+  if (get_headless() && *max_frames <= 0) {
+    fprintf(stderr, "--headless needs --frames N with N > 0\n");
+    return false;
+  }
+  return true;
 }
 
 /**
@@ -101,7 +215,17 @@ void free_resources(void){
  */
 int main(int argc, char *argv[]) {
 
+  int max_frames = 0;
+  char* trace_path = NULL;
+  bool is_pipelined = false;
+  if (!parse_args(argc, argv, &max_frames, &trace_path, &is_pipelined)) {
+    return 1;
+  }
+
+  // Every rendered frame, windowed or headless, goes to the capture: image
+  // files in captures/ or the --stream
   set_export(true);
+  set_frame_sink(capture_frame_sink, NULL);
 
   if (!initialize()) {
     printf("initialization() failed");
@@ -113,13 +237,39 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
-  while (is_running) {
-    process_input();
+  // Pipelined, the first frame is updated up front, then every frame updates
+  // the next one while it is rasterized: one frame of latency.
+  if (is_pipelined) {
     update();
-    render();
   }
 
-  destroy_save();
+  int frame_count = 0;
+  while (is_running) {
+    // Headless runs have no window to receive keyboard events from
+    if (!get_headless()) {
+      process_input();
+    }
+    PROFILE_BEGIN(PROF_FRAME);
+    if (is_pipelined) {
+      update_async();
+      render();
+      update_wait();
+    } else {
+      update();
+      render();
+    }
+    PROFILE_END(PROF_FRAME);
+    PROFILE_FRAME_END();
+
+    if (max_frames > 0 && ++frame_count >= max_frames) {
+      is_running = false;
+    }
+  }
+
+  if (trace_path != NULL) {
+    PROFILE_WRITE_TRACE(trace_path);
+  }
+
   destroy_display();
   free_resources();
   return 0;
@@ -1,5 +1,11 @@
 #include "matrix.h"
 #include "math.h"
+#include "cpu.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MATRIX_X86_SIMD
+#endif
 /**
  * @brief returns a 4 x 4 identity matrix
  *
@@ -187,3 +193,103 @@ mat4_t mat4_look_at(vec3_t eye, vec3_t target, vec3_t up) {
     }};
     return view_matrix;
 }
+
+///////////////////////////////////////////////////////////////////////////////
+// Batch transform of structure-of-arrays vertex streams
+///////////////////////////////////////////////////////////////////////////////
+// out = m * in for every vertex, where a missing in->w means w = 1 (positions)
+// and a missing out->w is not written. All paths evaluate the same sums in the
+// same order without FMA, so the results don't depend on the selected path.
+///////////////////////////////////////////////////////////////////////////////
+
+static void mat4_mul_vec4_batch_scalar(const mat4_t* m, const vec4_soa_t* in, vec4_soa_t* out, int first, int count){
+    for (int i = first; i < count; i++){
+        float x = in->x[i];
+        float y = in->y[i];
+        float z = in->z[i];
+        float w = in->w ? in->w[i] : 1.0;
+        out->x[i] = m->m[0][0] * x + m->m[0][1] * y + m->m[0][2] * z + m->m[0][3] * w;
+        out->y[i] = m->m[1][0] * x + m->m[1][1] * y + m->m[1][2] * z + m->m[1][3] * w;
+        out->z[i] = m->m[2][0] * x + m->m[2][1] * y + m->m[2][2] * z + m->m[2][3] * w;
+        if (out->w){
+            out->w[i] = m->m[3][0] * x + m->m[3][1] * y + m->m[3][2] * z + m->m[3][3] * w;
+        }
+    }
+}
+
+#ifdef MATRIX_X86_SIMD
+__attribute__((target("sse4.1")))
+static int mat4_mul_vec4_batch_sse(const mat4_t* m, const vec4_soa_t* in, vec4_soa_t* out, int count){
+    int i = 0;
+    __m128 one = _mm_set1_ps(1.0f);
+    for (; i + 4 <= count; i += 4){
+        __m128 x = _mm_loadu_ps(in->x + i);
+        __m128 y = _mm_loadu_ps(in->y + i);
+        __m128 z = _mm_loadu_ps(in->z + i);
+        __m128 w = in->w ? _mm_loadu_ps(in->w + i) : one;
+        for (int row = 0; row < 4; row++){
+            float* dst = row == 0 ? out->x : row == 1 ? out->y : row == 2 ? out->z : out->w;
+            if (dst == NULL){
+                continue;
+            }
+            __m128 r = _mm_mul_ps(_mm_set1_ps(m->m[row][0]), x);
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m->m[row][1]), y));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m->m[row][2]), z));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m->m[row][3]), w));
+            _mm_storeu_ps(dst + i, r);
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int mat4_mul_vec4_batch_avx2(const mat4_t* m, const vec4_soa_t* in, vec4_soa_t* out, int count){
+    int i = 0;
+    __m256 one = _mm256_set1_ps(1.0f);
+    for (; i + 8 <= count; i += 8){
+        __m256 x = _mm256_loadu_ps(in->x + i);
+        __m256 y = _mm256_loadu_ps(in->y + i);
+        __m256 z = _mm256_loadu_ps(in->z + i);
+        __m256 w = in->w ? _mm256_loadu_ps(in->w + i) : one;
+        for (int row = 0; row < 4; row++){
+            float* dst = row == 0 ? out->x : row == 1 ? out->y : row == 2 ? out->z : out->w;
+            if (dst == NULL){
+                continue;
+            }
+            __m256 r = _mm256_mul_ps(_mm256_set1_ps(m->m[row][0]), x);
+            r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_set1_ps(m->m[row][1]), y));
+            r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_set1_ps(m->m[row][2]), z));
+            r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_set1_ps(m->m[row][3]), w));
+            _mm256_storeu_ps(dst + i, r);
+        }
+    }
+    return i;
+}
+#endif
+
+/**
+ * @brief multiplies every vertex of a structure-of-arrays stream by one matrix,
+ *        using AVX2 or SSE when the CPU supports it (see cpu_simd_level()).
+ *
+ * @param
+ *      m     : 4x4 matrix
+ *      in    : input stream, in->w may be NULL for positions (w = 1)
+ *      out   : output stream, out->w may be NULL to skip w
+ *      count : number of vertices
+ * @return
+ */
+void mat4_mul_vec4_batch(const mat4_t* m, const vec4_soa_t* in, vec4_soa_t* out, int count){
+    int done = 0;
+#ifdef MATRIX_X86_SIMD
+    switch (cpu_simd_level()){
+    case SIMD_AVX2:
+        done = mat4_mul_vec4_batch_avx2(m, in, out, count);
+        break;
+    case SIMD_SSE:
+        done = mat4_mul_vec4_batch_sse(m, in, out, count);
+        break;
+    }
+#endif
+    // remaining vertices, or all of them without SIMD
+    mat4_mul_vec4_batch_scalar(m, in, out, done, count);
+}
@@ -1,22 +1,200 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
+#include <math.h>
 #include "string.h"
 #include "mesh.h"
 #include "array.h"
 #include "upng.h"
+#include "camera.h"
+#include "clip.h"
 
-// static array to handle multiple meshes
-#define MAX_NUM_MESHES 10
-static mesh_t meshes[MAX_NUM_MESHES];
-static int mesh_count = 0;
+// dynamic array to handle multiple meshes
+static mesh_t* meshes = NULL;
 
 
+/**
+ * @brief builds the structure-of-arrays copy of the vertices, which is the
+ *        input of the batch transform, and allocates the per-mesh vertex cache
+ *        that holds the vertices transformed into camera space (or clip space)
+ *        once per frame, together with their frustum outcodes.
+ *
+ * @param mesh: mesh with loaded vertices
+ * @return returns true, when all streams are allocated.
+ */
+static bool alloc_vertex_cache(mesh_t* mesh){
+    int num_vertices = array_length(mesh->vertices);
+    if (!vec4_soa_alloc(&mesh->positions, num_vertices, false) ||
+        !vec4_soa_alloc(&mesh->camera_vertices, num_vertices, false) ||
+        !vec4_soa_alloc(&mesh->clip_vertices, num_vertices, true)){
+        return false;
+    }
+    mesh->outcodes = (outcode_t*)malloc(sizeof(outcode_t) * (num_vertices > 0 ? num_vertices : 1));
+    if (mesh->outcodes == NULL){
+        return false;
+    }
+    for (int i = 0; i < num_vertices; i++){
+        mesh->positions.x[i] = mesh->vertices[i].x;
+        mesh->positions.y[i] = mesh->vertices[i].y;
+        mesh->positions.z[i] = mesh->vertices[i].z;
+    }
+    return true;
+}
+
+void mesh_set_rotation(mesh_t* mesh, vec3_t rotation){
+    mesh->rotation = rotation;
+    mesh->is_dirty = true;
+}
+
+void mesh_set_scale(mesh_t* mesh, vec3_t scale){
+    mesh->scale = scale;
+    mesh->is_dirty = true;
+}
+
+void mesh_set_translation(mesh_t* mesh, vec3_t translation){
+    mesh->translation = translation;
+    mesh->is_dirty = true;
+}
+
+/**
+ * @brief rebuilds the cached world matrix when the mesh transform changed, and
+ *        the model-view and model-view-projection matrices when either the
+ *        mesh or the camera changed. Static meshes under a static camera
+ *        don't recompute anything.
+ *
+ * @param mesh
+ * @return
+ */
+void mesh_update_matrices(mesh_t* mesh){
+    bool is_camera_changed = mesh->matrix_version != get_matrix_version();
+
+    if (mesh->is_dirty){
+        // Create a scale, rotation, and translation matrix that will be used to multiply the mesh vertices
+        mat4_t scale_matrix = mat4_make_scale(mesh->scale.x, mesh->scale.y, mesh->scale.z);
+        mat4_t translation_matrix = mat4_make_translation(mesh->translation.x, mesh->translation.y, mesh->translation.z);
+        mat4_t rotation_matrix_x = mat4_make_rotation_x(mesh->rotation.x);
+        mat4_t rotation_matrix_y = mat4_make_rotation_y(mesh->rotation.y);
+        mat4_t rotation_matrix_z = mat4_make_rotation_z(mesh->rotation.z);
+
+        // Order matters: scale -> rotate -> translate
+        mat4_t world_mat = mat4_identity();
+        world_mat = mat4_mul_mat4(scale_matrix, world_mat);
+        world_mat = mat4_mul_mat4(rotation_matrix_x, world_mat);
+        world_mat = mat4_mul_mat4(rotation_matrix_y, world_mat);
+        world_mat = mat4_mul_mat4(rotation_matrix_z, world_mat);
+        world_mat = mat4_mul_mat4(translation_matrix, world_mat);
+        mesh->world_mat = world_mat;
+    }
+
+    if (mesh->is_dirty || is_camera_changed){
+        mesh->model_view_mat = mat4_mul_mat4(get_view_mat(), mesh->world_mat);
+        mesh->mvp_mat = mat4_mul_mat4(get_proj_mat(), mesh->model_view_mat);
+        mesh->matrix_version = get_matrix_version();
+    }
+    mesh->is_dirty = false;
+}
+
+/**
+ * @brief computes the object-space AABB and bounding sphere of the vertices.
+ *        The sphere is centered in the box, its radius reaches the farthest
+ *        vertex.
+ *
+ * @param mesh: mesh with loaded vertices
+ * @return
+ */
+void mesh_compute_bounds(mesh_t* mesh){
+    int num_vertices = array_length(mesh->vertices);
+    if (num_vertices == 0){
+        mesh->aabb_min = mesh->aabb_max = mesh->bounding_center = vec3_new(0, 0, 0);
+        mesh->bounding_radius = 0;
+        return;
+    }
+
+    vec3_t min = mesh->vertices[0];
+    vec3_t max = mesh->vertices[0];
+    for (int i = 1; i < num_vertices; i++){
+        vec3_t v = mesh->vertices[i];
+        min.x = fminf(min.x, v.x); max.x = fmaxf(max.x, v.x);
+        min.y = fminf(min.y, v.y); max.y = fmaxf(max.y, v.y);
+        min.z = fminf(min.z, v.z); max.z = fmaxf(max.z, v.z);
+    }
+    vec3_t center = vec3_div(vec3_add(min, max), 2.0);
+
+    float radius_squared = 0;
+    for (int i = 0; i < num_vertices; i++){
+        vec3_t d = vec3_sub(mesh->vertices[i], center);
+        radius_squared = fmaxf(radius_squared, vec3_dot(d, d));
+    }
+
+    mesh->aabb_min = min;
+    mesh->aabb_max = max;
+    mesh->bounding_center = center;
+    mesh->bounding_radius = sqrtf(radius_squared);
+}
+
+/**
+ * @brief tests the bounding volumes of the mesh against the frustum planes in
+ *        camera space. The cheap sphere test decides most meshes, only meshes
+ *        whose sphere straddles a plane are refined with the 8 box corners.
+ *        Requires up to date matrices (see mesh_update_matrices()).
+ *
+ * @param mesh
+ * @return returns FRUSTUM_OUTSIDE, FRUSTUM_INSIDE or FRUSTUM_INTERSECT
+ */
+int mesh_classify_frustum(mesh_t* mesh){
+    mat4_t* mv = &mesh->model_view_mat;
+
+    // the radius grows with the largest axis scale of the model-view matrix
+    float max_scale_squared = 0;
+    for (int j = 0; j < 3; j++){
+        float scale_squared = mv->m[0][j] * mv->m[0][j] + mv->m[1][j] * mv->m[1][j] + mv->m[2][j] * mv->m[2][j];
+        max_scale_squared = fmaxf(max_scale_squared, scale_squared);
+    }
+    vec3_t center = vec3_from_vec4(mat4_mul_vec4(*mv, vec4_from_vec3(mesh->bounding_center)));
+    int result = frustum_classify_sphere(center, mesh->bounding_radius * sqrtf(max_scale_squared));
+    if (result != FRUSTUM_INTERSECT){
+        return result;
+    }
+
+    vec3_t corners[8];
+    for (int i = 0; i < 8; i++){
+        vec3_t corner = {
+            (i & 1) ? mesh->aabb_max.x : mesh->aabb_min.x,
+            (i & 2) ? mesh->aabb_max.y : mesh->aabb_min.y,
+            (i & 4) ? mesh->aabb_max.z : mesh->aabb_min.z
+        };
+        corners[i] = vec3_from_vec4(mat4_mul_vec4(*mv, vec4_from_vec3(corner)));
+    }
+    return frustum_classify_points(corners, 8);
+}
+
+/**
+ * @brief tests the bounding box of the mesh against the frustum in homogeneous
+ *        clip space, with the 8 corners multiplied by the model-view-projection
+ *        matrix. Needs no frustum plane setup.
+ *
+ * @param mesh
+ * @return returns FRUSTUM_OUTSIDE, FRUSTUM_INSIDE or FRUSTUM_INTERSECT
+ */
+int mesh_classify_clip_space(mesh_t* mesh){
+    vec4_t corners[8];
+    for (int i = 0; i < 8; i++){
+        vec3_t corner = {
+            (i & 1) ? mesh->aabb_max.x : mesh->aabb_min.x,
+            (i & 2) ? mesh->aabb_max.y : mesh->aabb_min.y,
+            (i & 4) ? mesh->aabb_max.z : mesh->aabb_min.z
+        };
+        corners[i] = mat4_mul_vec4(mesh->mvp_mat, vec4_from_vec3(corner));
+    }
+    return frustum_classify_clip_points(corners, 8);
+}
+
 mesh_t* get_mesh(int index){
     return &meshes[index];
 }
 
 int get_num_meshes(void){
-    return mesh_count;
+    return array_length(meshes);
 }
 
 bool load_mesh(char* obj_filename,
@@ -25,16 +203,67 @@ bool load_mesh(char* obj_filename,
                vec3_t translation,
                vec3_t rotation){
 
-    if (!load_mesh_obj_data(&meshes[mesh_count], obj_filename)){
+    mesh_t mesh = { 0 };
+    if (!load_mesh_obj_data(&mesh, obj_filename)){
         return false;
     }
-    if (!load_mesh_png_data(&meshes[mesh_count], png_filename)){
+    if (!load_mesh_png_data(&mesh, png_filename)){
         return false;
     }
-    meshes[mesh_count].scale = scale;
-    meshes[mesh_count].translation = translation;
-    meshes[mesh_count].rotation = rotation;
-    mesh_count++;
+    mesh.material = texture_register(mesh.texture);
+    if (mesh.material < 0){
+        return false;
+    }
+    if (!alloc_vertex_cache(&mesh)){
+        return false;
+    }
+    mesh.scale = scale;
+    mesh.translation = translation;
+    mesh.rotation = rotation;
+    mesh.is_dirty = true;
+    array_push(meshes, mesh);
+    return true;
+}
+
+/**
+ * @brief adds a mesh built in memory (e.g. procedural geometry) to the scene.
+ *        The mesh takes ownership of the vertices, faces and texcoords dynamic
+ *        arrays and of the decoded texture, they are released by free_mesh().
+ *
+ * @param vertices, faces, texcoords: dynamic arrays (see array.h)
+ *        texture: decoded texture
+ * @return returns true, when the mesh is added.
+ */
+bool load_mesh_data(vec3_t* vertices,
+                    face_t* faces,
+                    tex2_t* texcoords,
+                    upng_t* texture,
+                    vec3_t scale,
+                    vec3_t translation,
+                    vec3_t rotation){
+
+    if (vertices == NULL || faces == NULL || texcoords == NULL || texture == NULL){
+        return false;
+    }
+    mesh_t mesh = {
+        .vertices = vertices,
+        .faces = faces,
+        .texcoords = texcoords,
+        .texture = texture,
+        .rotation = rotation,
+        .scale = scale,
+        .translation = translation,
+        .is_dirty = true
+    };
+    mesh.material = texture_register(texture);
+    if (mesh.material < 0){
+        return false;
+    }
+    mesh_compute_bounds(&mesh);
+    if (!alloc_vertex_cache(&mesh)){
+        return false;
+    }
+    array_push(meshes, mesh);
     return true;
 }
 
@@ -58,8 +287,6 @@ bool load_mesh_obj_data(mesh_t* mesh, char * filename){
         return false;
     }
 
-    tex2_t* texcoords = NULL;
-
     char line[512]; // 512 characters per line expected. char: 1 byte
     while (fgets(line, sizeof(line), file)){
         printf("Line = %s", line);
@@ -77,7 +304,7 @@ bool load_mesh_obj_data(mesh_t* mesh, char * filename){
             // texture coordinate information
             tex2_t texcoord;
             sscanf(line, "vt %f %f", &texcoord.u, &texcoord.v);
-            array_push(texcoords, texcoord);
+            array_push(mesh->texcoords, texcoord);
         } else if (strncmp(line, "vn ", 3) == 0){
             // vertex normal
             // TODO: implement what's for vn
@@ -96,9 +323,9 @@ bool load_mesh_obj_data(mesh_t* mesh, char * filename){
                     .a = vertex_indices[0]-1,
                     .b = vertex_indices[1]-1,
                     .c = vertex_indices[2]-1,
-                    .a_uv = texcoords[texture_indices[0]-1],
-                    .b_uv = texcoords[texture_indices[1]-1],
-                    .c_uv = texcoords[texture_indices[2]-1],
+                    .a_uv = texture_indices[0]-1,
+                    .b_uv = texture_indices[1]-1,
+                    .c_uv = texture_indices[2]-1,
                     .color = 0xFFFFFFFF
                 };
                 array_push(mesh->faces, face);
@@ -110,7 +337,7 @@ bool load_mesh_obj_data(mesh_t* mesh, char * filename){
             continue;
         }
     }
-    array_free(texcoords);
+    mesh_compute_bounds(mesh);
     return true;
 }
 
@@ -185,7 +412,7 @@ bool load_mesh_obj_data(mesh_t* mesh, char * filename){
 
 
 void free_mesh(void){
-    for (int i = 0; i < mesh_count; i++){
+    for (int i = 0; i < get_num_meshes(); i++){
         upng_free(meshes[i].texture);
         if (array_length(meshes[i].vertices) != 0){
             array_free(meshes[i].vertices);
@@ -193,5 +420,13 @@ void free_mesh(void){
         if (array_length(meshes[i].faces) != 0){
             array_free(meshes[i].faces);
         }
+        array_free(meshes[i].texcoords);
+        vec4_soa_free(&meshes[i].positions);
+        vec4_soa_free(&meshes[i].camera_vertices);
+        vec4_soa_free(&meshes[i].clip_vertices);
+        free(meshes[i].outcodes);
     }
+    array_free(meshes);
+    meshes = NULL;
+    texture_clear_registry();
 }
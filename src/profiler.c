@@ -0,0 +1,220 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime() and pthreads in -std=c99
+#include "profiler.h"
+
+#ifdef PROFILE
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include "array.h"
+#include "job.h"
+
+// Upper bound of recorded trace events, so that long runs don't grow forever
+#define PROFILER_MAX_EVENTS (1 << 20)
+
+typedef struct {
+    int stage;
+    int thread; // job_thread_index(), one trace row per thread
+    double ts;  // start in microseconds since the first profiled event
+    double dur; // duration in microseconds
+} trace_event_t;
+
+typedef struct {
+    double ts;
+    double stage_us[PROF_NUM_STAGES]; // summed over all threads
+    double job_us[PROF_NUM_STAGES]; // time of the stage's jobs, summed over all threads
+    uint64_t counters[PROF_NUM_COUNTERS];
+} frame_record_t;
+
+static const char* stage_names[PROF_NUM_STAGES] = {
+    "frame", "update", "geometry", "transform", "cull", "clip", "project",
+    "render", "clear_color_buffer", "clear_z_buffer", "bin", "raster", "texture_upload", "export"
+};
+
+static const char* counter_names[PROF_NUM_COUNTERS] = {
+    "faces_in", "faces_culled", "faces_clipped", "triangles_emitted", "pixels_tested", "pixels_written",
+    "meshes_culled", "meshes_unclipped",
+    "faces_accepted", "faces_rejected", "faces_straddling",
+    "blocks_skipped", "blocks_partial", "blocks_covered",
+    "jobs_run", "jobs_stolen"
+};
+
+// Stages that run once per face are only accumulated, a trace event each would
+// cost more than the work being measured.
+static const bool stage_is_traced[PROF_NUM_STAGES] = {
+    true, true, true, false, false, false, false,
+    true, true, true, true, true, true, true
+};
+
+static pthread_once_t origin_once = PTHREAD_ONCE_INIT;
+static struct timespec origin;
+static __thread double stage_start[PROF_NUM_STAGES];
+static __thread double thread_stage_us[PROF_NUM_STAGES];     // stage times since the last flush
+static __thread uint64_t thread_counters[PROF_NUM_COUNTERS]; // counts since the last flush
+static __thread double job_start;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; // job events and the current frame
+static frame_record_t current_frame;
+static uint64_t totals[PROF_NUM_COUNTERS];
+
+static trace_event_t* stage_events = NULL; // dynamic array, main thread only
+static trace_event_t* job_events = NULL;   // dynamic array, under the lock
+static frame_record_t* frames = NULL;   // dynamic array
+
+// Sets the time origin of all events, once, at the first profiled event
+static void init_origin(void){
+    clock_gettime(CLOCK_MONOTONIC, &origin);
+}
+
+/**
+ * @brief returns the microseconds since the first profiled event.
+ *
+ * @param
+ * @return
+ */
+static double profiler_now(void){
+    pthread_once(&origin_once, init_origin);
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - origin.tv_sec) * 1e6 + (t.tv_nsec - origin.tv_nsec) / 1e3;
+}
+
+// Stages are timed on every thread, e.g. the per-face geometry stages run in
+// jobs on all of them. Each thread sums its stage times on its own and flushes
+// them with the counters. Trace events are only recorded on the main thread.
+void profiler_begin(int stage){
+    stage_start[stage] = profiler_now();
+}
+
+void profiler_end(int stage){
+    double end = profiler_now();
+    double dur = end - stage_start[stage];
+    thread_stage_us[stage] += dur;
+
+    if (stage_is_traced[stage] && !job_is_worker_thread() && array_length(stage_events) < PROFILER_MAX_EVENTS){
+        trace_event_t event = { stage, 0, stage_start[stage], dur };
+        array_push(stage_events, event);
+    }
+}
+
+/**
+ * @brief adds the calling thread's stage times and counts to the current
+ *        frame, once per job instead of once per pixel or face on memory
+ *        shared by all threads. Call with the lock held.
+ */
+static void flush_thread_totals(void){
+    for (int i = 0; i < PROF_NUM_STAGES; i++){
+        current_frame.stage_us[i] += thread_stage_us[i];
+        thread_stage_us[i] = 0;
+    }
+    for (int i = 0; i < PROF_NUM_COUNTERS; i++){
+        current_frame.counters[i] += thread_counters[i];
+        thread_counters[i] = 0;
+    }
+}
+
+// Timing hooks of the job scheduler, called on the thread that runs the job
+void profiler_job_begin(int stage){
+    job_start = profiler_now();
+}
+
+void profiler_job_end(int stage){
+    double dur = profiler_now() - job_start;
+    pthread_mutex_lock(&lock);
+    flush_thread_totals();
+    current_frame.job_us[stage] += dur;
+    if (array_length(job_events) < PROFILER_MAX_EVENTS){
+        trace_event_t event = { stage, job_thread_index(), job_start, dur };
+        array_push(job_events, event);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+// Counters are bumped by the worker threads, too. Each thread counts on its
+// own, and flushes at the end of every job and, on the main thread, frame.
+void profiler_count(int counter, int n){
+    thread_counters[counter] += (uint64_t)n;
+}
+
+/**
+ * @brief closes the per-frame stage times and counters and starts a new frame.
+ *
+ * @param
+ * @return
+ */
+void profiler_frame_end(void){
+    pthread_mutex_lock(&lock);
+    flush_thread_totals();
+    for (int i = 0; i < PROF_NUM_COUNTERS; i++){
+        totals[i] += current_frame.counters[i];
+    }
+    if (array_length(frames) < PROFILER_MAX_EVENTS){
+        array_push(frames, current_frame);
+    }
+    frame_record_t empty = { 0 };
+    current_frame = empty;
+    current_frame.ts = profiler_now();
+    pthread_mutex_unlock(&lock);
+}
+
+uint64_t profiler_get_total(int counter){
+    return totals[counter];
+}
+
+/**
+ * @brief writes all recorded events in the Chrome trace event format (JSON).
+ *        Scoped stages and jobs become complete ("X") events, the accumulated stage
+ *        times and the counters become one counter ("C") event per frame.
+ *
+ * @param path: output file, e.g. "trace.json"
+ * @return returns true, when the file was written.
+ */
+bool profiler_write_trace(const char* path){
+    FILE* file = fopen(path, "w");
+    if (!file){
+        perror("Failed to open trace file");
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"renderer\"}}");
+    for (int t = 0; t < job_num_threads(); t++){
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                t + 1, t ? "worker" : "main", t);
+    }
+
+    trace_event_t* event_lists[2] = { stage_events, job_events };
+    for (int l = 0; l < 2; l++){
+        trace_event_t* events = event_lists[l];
+        for (int i = 0; i < array_length(events); i++){
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                    stage_names[events[i].stage], events[i].ts, events[i].dur, events[i].thread + 1);
+        }
+    }
+
+    for (int i = 0; i < array_length(frames); i++){
+        fprintf(file, ",\n{\"name\":\"stage_ms\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{", frames[i].ts);
+        for (int s = 0; s < PROF_NUM_STAGES; s++){
+            fprintf(file, "%s\"%s\":%.4f", s ? "," : "", stage_names[s], frames[i].stage_us[s] / 1e3);
+        }
+        fprintf(file, "}}");
+
+        fprintf(file, ",\n{\"name\":\"job_ms\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{", frames[i].ts);
+        for (int s = 0; s < PROF_NUM_STAGES; s++){
+            fprintf(file, "%s\"%s\":%.4f", s ? "," : "", stage_names[s], frames[i].job_us[s] / 1e3);
+        }
+        fprintf(file, "}}");
+
+        fprintf(file, ",\n{\"name\":\"counters\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{", frames[i].ts);
+        for (int c = 0; c < PROF_NUM_COUNTERS; c++){
+            fprintf(file, "%s\"%s\":%llu", c ? "," : "", counter_names[c], (unsigned long long)frames[i].counters[c]);
+        }
+        fprintf(file, "}}");
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    printf("[profile] %d frames written to %s\n", array_length(frames), path);
+    return true;
+}
+
+#endif // PROFILE
@@ -0,0 +1,347 @@
+#define _POSIX_C_SOURCE 200809L // dup() and fdopen() in -std=c99
+#include "stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cpu.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define STREAM_X86_SIMD
+#endif
+
+static FILE* stream_file = NULL;
+static int stream_format = STREAM_Y4M;
+static int stream_width = 0;
+static int stream_height = 0;
+static uint8_t* yuv_planes = NULL; // Y, then U, then V of one frame
+
+////////////////////////////////////////////////////////////////////////////////
+// RGBA to YUV 4:2:0, BT.601 limited range, in 8 bit fixed point:
+//     Y = ((  66 R + 129 G +  25 B + 128) >> 8) +  16
+//     U = (( -38 R -  74 G + 112 B + 128) >> 8) + 128
+//     V = (( 112 R -  94 G -  18 B + 128) >> 8) + 128
+// U and V of every 2x2 pixels from their rounded average RGB. The kernels
+// match the scalar code exactly.
+////////////////////////////////////////////////////////////////////////////////
+
+static void luma_row_scalar(const uint8_t* src, uint8_t* dst, int first, int end){
+    for (int x = first; x < end; x++){
+        const uint8_t* p = src + 4 * x;
+        dst[x] = (uint8_t)(((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16);
+    }
+}
+
+/**
+ * @brief U and V of the pixels [first, end) of one chroma row, from the source
+ *        rows src0 and src1. The last column and row repeat for odd sizes.
+ */
+static void chroma_row_scalar(const uint8_t* src0, const uint8_t* src1, int width, uint8_t* u, uint8_t* v,
+                              int first, int end){
+    for (int x = first; x < end; x++){
+        int x0 = 2 * x;
+        int x1 = 2 * x + 1 < width ? 2 * x + 1 : x0;
+        int rgb[3];
+        for (int c = 0; c < 3; c++){
+            rgb[c] = (src0[4 * x0 + c] + src0[4 * x1 + c] + src1[4 * x0 + c] + src1[4 * x1 + c] + 2) >> 2;
+        }
+        u[x] = (uint8_t)(((-38 * rgb[0] - 74 * rgb[1] + 112 * rgb[2] + 128) >> 8) + 128);
+        v[x] = (uint8_t)(((112 * rgb[0] - 94 * rgb[1] - 18 * rgb[2] + 128) >> 8) + 128);
+    }
+}
+
+#ifdef STREAM_X86_SIMD
+/**
+ * @brief weighted R, G, B sums of 4 pixels, in 16 bit channels: 2 pixels each
+ *        in lo and hi. Returns 4 int32, rounded and shifted by 8.
+ */
+__attribute__((target("sse4.1")))
+static inline __m128i weigh_rgb_sse(__m128i lo, __m128i hi, __m128i weights){
+    __m128i sum = _mm_hadd_epi32(_mm_madd_epi16(lo, weights), _mm_madd_epi16(hi, weights));
+    return _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i luma4_sse(__m128i pixels, __m128i weights){
+    __m128i zero = _mm_setzero_si128();
+    __m128i y = weigh_rgb_sse(_mm_unpacklo_epi8(pixels, zero), _mm_unpackhi_epi8(pixels, zero), weights);
+    return _mm_add_epi32(y, _mm_set1_epi32(16));
+}
+
+__attribute__((target("sse4.1")))
+static int luma_row_sse(const uint8_t* src, uint8_t* dst, int width){
+    int x = 0;
+    __m128i weights = _mm_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0);
+    for (; x + 16 <= width; x += 16){
+        __m128i y0 = luma4_sse(_mm_loadu_si128((const __m128i*)(src + 4 * x)), weights);
+        __m128i y1 = luma4_sse(_mm_loadu_si128((const __m128i*)(src + 4 * x + 16)), weights);
+        __m128i y2 = luma4_sse(_mm_loadu_si128((const __m128i*)(src + 4 * x + 32)), weights);
+        __m128i y3 = luma4_sse(_mm_loadu_si128((const __m128i*)(src + 4 * x + 48)), weights);
+        __m128i y = _mm_packus_epi16(_mm_packs_epi32(y0, y1), _mm_packs_epi32(y2, y3));
+        _mm_storeu_si128((__m128i*)(dst + x), y);
+    }
+    return x;
+}
+
+__attribute__((target("sse4.1")))
+static int chroma_row_sse(const uint8_t* src0, const uint8_t* src1, uint8_t* u, uint8_t* v, int width){
+    int x = 0;
+    __m128i zero = _mm_setzero_si128();
+    __m128i two = _mm_set1_epi16(2);
+    __m128i u_weights = _mm_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0);
+    __m128i v_weights = _mm_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0);
+    __m128i offset = _mm_set1_epi32(128);
+    for (; x + 4 <= width; x += 4){
+        // Average 2x2 pixels, as in capture_downscale_2x(), in 16 bit channels
+        __m128 a0 = _mm_loadu_ps((const float*)(src0 + 8 * x));
+        __m128 b0 = _mm_loadu_ps((const float*)(src0 + 8 * x + 16));
+        __m128 a1 = _mm_loadu_ps((const float*)(src1 + 8 * x));
+        __m128 b1 = _mm_loadu_ps((const float*)(src1 + 8 * x + 16));
+        __m128i even0 = _mm_castps_si128(_mm_shuffle_ps(a0, b0, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i odd0 = _mm_castps_si128(_mm_shuffle_ps(a0, b0, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i even1 = _mm_castps_si128(_mm_shuffle_ps(a1, b1, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i odd1 = _mm_castps_si128(_mm_shuffle_ps(a1, b1, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(even0, zero), _mm_unpacklo_epi8(odd0, zero));
+        lo = _mm_add_epi16(lo, _mm_add_epi16(_mm_unpacklo_epi8(even1, zero), _mm_unpacklo_epi8(odd1, zero)));
+        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(even0, zero), _mm_unpackhi_epi8(odd0, zero));
+        hi = _mm_add_epi16(hi, _mm_add_epi16(_mm_unpackhi_epi8(even1, zero), _mm_unpackhi_epi8(odd1, zero)));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+
+        __m128i u4 = _mm_add_epi32(weigh_rgb_sse(lo, hi, u_weights), offset);
+        __m128i v4 = _mm_add_epi32(weigh_rgb_sse(lo, hi, v_weights), offset);
+        __m128i uv = _mm_packus_epi16(_mm_packs_epi32(u4, v4), zero);
+        int32_t u_bytes = _mm_cvtsi128_si32(uv);
+        int32_t v_bytes = _mm_extract_epi32(uv, 1);
+        memcpy(u + x, &u_bytes, 4);
+        memcpy(v + x, &v_bytes, 4);
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i weigh_rgb_avx2(__m256i lo, __m256i hi, __m256i weights){
+    __m256i sum = _mm256_hadd_epi32(_mm256_madd_epi16(lo, weights), _mm256_madd_epi16(hi, weights));
+    return _mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(128)), 8);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i luma8_avx2(__m256i pixels, __m256i weights){
+    __m256i zero = _mm256_setzero_si256();
+    __m256i y = weigh_rgb_avx2(_mm256_unpacklo_epi8(pixels, zero), _mm256_unpackhi_epi8(pixels, zero), weights);
+    return _mm256_add_epi32(y, _mm256_set1_epi32(16));
+}
+
+__attribute__((target("avx2")))
+static int luma_row_avx2(const uint8_t* src, uint8_t* dst, int width){
+    int x = 0;
+    __m256i weights = _mm256_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0, 66, 129, 25, 0, 66, 129, 25, 0);
+    // The packs interleave groups of 4 pixels across the lanes, this sorts them
+    __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    for (; x + 32 <= width; x += 32){
+        __m256i y0 = luma8_avx2(_mm256_loadu_si256((const __m256i*)(src + 4 * x)), weights);
+        __m256i y1 = luma8_avx2(_mm256_loadu_si256((const __m256i*)(src + 4 * x + 32)), weights);
+        __m256i y2 = luma8_avx2(_mm256_loadu_si256((const __m256i*)(src + 4 * x + 64)), weights);
+        __m256i y3 = luma8_avx2(_mm256_loadu_si256((const __m256i*)(src + 4 * x + 96)), weights);
+        __m256i y = _mm256_packus_epi16(_mm256_packs_epi32(y0, y1), _mm256_packs_epi32(y2, y3));
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_permutevar8x32_epi32(y, order));
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int chroma_row_avx2(const uint8_t* src0, const uint8_t* src1, uint8_t* u, uint8_t* v, int width){
+    int x = 0;
+    __m256i zero = _mm256_setzero_si256();
+    __m256i two = _mm256_set1_epi16(2);
+    __m256i u_weights = _mm256_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0, -38, -74, 112, 0, -38, -74, 112, 0);
+    __m256i v_weights = _mm256_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0, 112, -94, -18, 0, 112, -94, -18, 0);
+    __m256i offset = _mm256_set1_epi32(128);
+    __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    for (; x + 8 <= width; x += 8){
+        __m256 a0 = _mm256_loadu_ps((const float*)(src0 + 8 * x));
+        __m256 b0 = _mm256_loadu_ps((const float*)(src0 + 8 * x + 32));
+        __m256 a1 = _mm256_loadu_ps((const float*)(src1 + 8 * x));
+        __m256 b1 = _mm256_loadu_ps((const float*)(src1 + 8 * x + 32));
+        __m256i even0 = _mm256_castps_si256(_mm256_shuffle_ps(a0, b0, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m256i odd0 = _mm256_castps_si256(_mm256_shuffle_ps(a0, b0, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m256i even1 = _mm256_castps_si256(_mm256_shuffle_ps(a1, b1, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m256i odd1 = _mm256_castps_si256(_mm256_shuffle_ps(a1, b1, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(even0, zero), _mm256_unpacklo_epi8(odd0, zero));
+        lo = _mm256_add_epi16(lo, _mm256_add_epi16(_mm256_unpacklo_epi8(even1, zero), _mm256_unpacklo_epi8(odd1, zero)));
+        __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(even0, zero), _mm256_unpackhi_epi8(odd0, zero));
+        hi = _mm256_add_epi16(hi, _mm256_add_epi16(_mm256_unpackhi_epi8(even1, zero), _mm256_unpackhi_epi8(odd1, zero)));
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, two), 2);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, two), 2);
+
+        // lo holds the pixels 0 1 | 2 3 and hi 4 5 | 6 7, so that the hadd
+        // returns them in order, swap the upper half of lo and lower of hi
+        __m256i sorted_lo = _mm256_permute2x128_si256(lo, hi, 0x20);
+        hi = _mm256_permute2x128_si256(lo, hi, 0x31);
+        lo = sorted_lo;
+        __m256i u8 = _mm256_add_epi32(weigh_rgb_avx2(lo, hi, u_weights), offset);
+        __m256i v8 = _mm256_add_epi32(weigh_rgb_avx2(lo, hi, v_weights), offset);
+        __m256i uv = _mm256_packus_epi16(_mm256_packs_epi32(u8, v8), zero);
+        uv = _mm256_permutevar8x32_epi32(uv, order);
+        __m128i uv16 = _mm256_castsi256_si128(uv);
+        _mm_storel_epi64((__m128i*)(u + x), uv16);
+        _mm_storel_epi64((__m128i*)(v + x), _mm_srli_si128(uv16, 8));
+    }
+    return x;
+}
+#endif
+
+/**
+ * @brief converts an RGBA frame to YUV 4:2:0 planes, using AVX2 or SSE when
+ *        the CPU supports it (see cpu_simd_level()).
+ *
+ * @param
+ *      frame   : RGBA frame, any size
+ *      y_plane : width x height bytes
+ *      u_plane, v_plane : (width + 1) / 2 x (height + 1) / 2 bytes each
+ * @return
+ */
+void rgba_to_yuv420(const capture_frame_t* frame, uint8_t* y_plane, uint8_t* u_plane, uint8_t* v_plane){
+    int level = cpu_simd_level();
+    int chroma_width = (frame->width + 1) / 2;
+    int chroma_height = (frame->height + 1) / 2;
+
+    for (int y = 0; y < frame->height; y++){
+        const uint8_t* src = frame->pixels + (size_t)y * frame->pitch;
+        uint8_t* dst = y_plane + (size_t)y * frame->width;
+        int done = 0;
+#ifdef STREAM_X86_SIMD
+        switch (level){
+        case SIMD_AVX2:
+            done = luma_row_avx2(src, dst, frame->width);
+            break;
+        case SIMD_SSE:
+            done = luma_row_sse(src, dst, frame->width);
+            break;
+        }
+#endif
+        // remaining pixels, or all of them without SIMD
+        luma_row_scalar(src, dst, done, frame->width);
+    }
+
+    for (int y = 0; y < chroma_height; y++){
+        int row1 = 2 * y + 1 < frame->height ? 2 * y + 1 : 2 * y;
+        const uint8_t* src0 = frame->pixels + (size_t)(2 * y) * frame->pitch;
+        const uint8_t* src1 = frame->pixels + (size_t)row1 * frame->pitch;
+        uint8_t* u = u_plane + (size_t)y * chroma_width;
+        uint8_t* v = v_plane + (size_t)y * chroma_width;
+        int done = 0;
+#ifdef STREAM_X86_SIMD
+        // The kernels only take whole 2x2 blocks, the scalar code the odd column
+        switch (level){
+        case SIMD_AVX2:
+            done = chroma_row_avx2(src0, src1, u, v, frame->width / 2);
+            break;
+        case SIMD_SSE:
+            done = chroma_row_sse(src0, src1, u, v, frame->width / 2);
+            break;
+        }
+#endif
+        chroma_row_scalar(src0, src1, frame->width, u, v, done, chroma_width);
+    }
+}
+
+/**
+ * @brief opens the stream and writes its header.
+ *
+ * @param path: file to write, "-" for stdout. Then everything else printed to
+ *              stdout goes to stderr, to keep the stream clean.
+ *        format: one of enum stream_format
+ *        width, height: frame size in pixels
+ *        fps: frame rate in the Y4M header
+ * @return returns false, when the file could not be opened.
+ */
+bool stream_open(const char* path, int format, int width, int height, int fps){
+    stream_close();
+
+    if (strcmp(path, "-") == 0){
+        fflush(stdout);
+        int fd = dup(STDOUT_FILENO);
+        if (fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0){
+            perror("Failed to redirect stdout");
+            return false;
+        }
+        stream_file = fdopen(fd, "wb");
+    }else{
+        stream_file = fopen(path, "wb");
+    }
+    if (stream_file == NULL){
+        perror("Failed to open the stream");
+        return false;
+    }
+
+    stream_format = format;
+    stream_width = width;
+    stream_height = height;
+    if (format == STREAM_Y4M){
+        size_t chroma_size = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+        yuv_planes = (uint8_t*)malloc((size_t)width * height + 2 * chroma_size);
+        if (yuv_planes == NULL){
+            stream_close();
+            return false;
+        }
+        // C420jpeg: chroma centered between the 2x2 pixels, as averaged
+        fprintf(stream_file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+    }
+    return true;
+}
+
+/**
+ * @brief capture writer: appends a frame to the stream. Not thread-safe, use
+ *        a single capture encoder, which also keeps the frames in order.
+ *
+ * @param frame: RGBA frame, of the size given to stream_open()
+ *        user_data: unused
+ * @return returns false, when the frame could not be written.
+ */
+bool stream_write_frame(const capture_frame_t* frame, void* user_data){
+    if (stream_file == NULL || frame->width != stream_width || frame->height != stream_height){
+        return false;
+    }
+
+    if (stream_format == STREAM_Y4M){
+        size_t luma_size = (size_t)stream_width * stream_height;
+        size_t chroma_size = (size_t)((stream_width + 1) / 2) * ((stream_height + 1) / 2);
+        size_t size = luma_size + 2 * chroma_size;
+        rgba_to_yuv420(frame, yuv_planes, yuv_planes + luma_size, yuv_planes + luma_size + chroma_size);
+        return fputs("FRAME\n", stream_file) >= 0 && fwrite(yuv_planes, 1, size, stream_file) == size;
+    }
+
+    for (int y = 0; y < frame->height; y++){
+        size_t row_size = (size_t)frame->width * 4;
+        if (fwrite(frame->pixels + (size_t)y * frame->pitch, 1, row_size, stream_file) != row_size){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief flushes and closes the stream.
+ *
+ * @param
+ * @return
+ */
+void stream_close(void){
+    if (stream_file != NULL){
+        fclose(stream_file);
+        stream_file = NULL;
+    }
+    free(yuv_planes);
+    yuv_planes = NULL;
+}
+
+const char* stream_format_name(int format){
+    switch (format){
+    case STREAM_RGBA:
+        return "rgba";
+    default:
+        return "y4m";
+    }
+}
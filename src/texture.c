@@ -1,7 +1,35 @@
 #include <stdbool.h>
+#include <stdlib.h>
 #include "texture.h"
+#include "array.h"
+
+// dynamic array of registered textures, indexed by material
+static upng_t** textures = NULL;
 
 tex2_t tex2_clone(tex2_t* t){
     tex2_t result = {t->u, t->v};
     return result;
 }
+
+/**
+ * @brief adds a texture to the registry. The registry doesn't own it.
+ *
+ * @param texture: decoded texture
+ * @return returns the material index, or -1 when the registry is full.
+ */
+int texture_register(upng_t* texture){
+    if (array_length(textures) >= MAX_TEXTURES){
+        return -1;
+    }
+    array_push(textures, texture);
+    return array_length(textures) - 1;
+}
+
+upng_t* texture_get(int material){
+    return textures[material];
+}
+
+void texture_clear_registry(void){
+    array_free(textures);
+    textures = NULL;
+}
@@ -0,0 +1,103 @@
+#include <stdlib.h>
+#include "tile.h"
+#include "array.h"
+
+static tile_t* tiles = NULL;
+static int num_tiles_x = 0;
+static int num_tiles_y = 0;
+static int tiles_width = 0;
+static int tiles_height = 0;
+
+/**
+ * @brief splits the viewport into tiles of TILE_SIZE x TILE_SIZE pixels, the
+ *        ones on the right and bottom border are cut.
+ *
+ * @param window_width, window_height: viewport
+ * @return returns true, when the tiles are allocated.
+ */
+bool init_tiles(int window_width, int window_height){
+    free_tiles();
+    num_tiles_x = (window_width + TILE_SIZE - 1) / TILE_SIZE;
+    num_tiles_y = (window_height + TILE_SIZE - 1) / TILE_SIZE;
+    tiles_width = window_width;
+    tiles_height = window_height;
+
+    tiles = (tile_t*)calloc(num_tiles_x * num_tiles_y, sizeof(tile_t));
+    if (tiles == NULL){
+        return false;
+    }
+    for (int ty = 0; ty < num_tiles_y; ty++){
+        for (int tx = 0; tx < num_tiles_x; tx++){
+            rect_t* rect = &tiles[ty * num_tiles_x + tx].rect;
+            rect->x_min = tx * TILE_SIZE;
+            rect->y_min = ty * TILE_SIZE;
+            rect->x_max = rect->x_min + TILE_SIZE - 1 < window_width ? rect->x_min + TILE_SIZE - 1 : window_width - 1;
+            rect->y_max = rect->y_min + TILE_SIZE - 1 < window_height ? rect->y_min + TILE_SIZE - 1 : window_height - 1;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief sorts the triangles into the bins of the tiles their pixel bounding
+ *        box overlaps. The box is conservative: it covers the pixel centers
+ *        of the filled triangle as well as its wireframe and vertex dots.
+ *
+ * @param triangles: triangle stream of the frame
+ *        num_triangles: length of the stream
+ * @return
+ */
+void bin_triangles_to_tiles(const screen_triangle_t* triangles, int num_triangles){
+    for (int i = 0; i < num_tiles_x * num_tiles_y; i++){
+        array_clear(tiles[i].triangles);
+    }
+
+    for (int i = 0; i < num_triangles; i++){
+        const screen_triangle_t* t = &triangles[i];
+        int32_t x_min = t->x[0], x_max = t->x[0], y_min = t->y[0], y_max = t->y[0];
+        for (int j = 1; j < 3; j++){
+            if (t->x[j] < x_min) x_min = t->x[j];
+            if (t->x[j] > x_max) x_max = t->x[j];
+            if (t->y[j] < y_min) y_min = t->y[j];
+            if (t->y[j] > y_max) y_max = t->y[j];
+        }
+
+        // pixels, with the 3x3 vertex dots to the bottom right
+        int px_min = (x_min >> SUBPIXEL_BITS) - 1;
+        int py_min = (y_min >> SUBPIXEL_BITS) - 1;
+        int px_max = (x_max >> SUBPIXEL_BITS) + 2;
+        int py_max = (y_max >> SUBPIXEL_BITS) + 2;
+        if (px_max < 0 || py_max < 0 || px_min >= tiles_width || py_min >= tiles_height){
+            continue;
+        }
+        int tx_min = px_min > 0 ? px_min / TILE_SIZE : 0;
+        int ty_min = py_min > 0 ? py_min / TILE_SIZE : 0;
+        int tx_max = px_max < tiles_width ? px_max / TILE_SIZE : num_tiles_x - 1;
+        int ty_max = py_max < tiles_height ? py_max / TILE_SIZE : num_tiles_y - 1;
+
+        for (int ty = ty_min; ty <= ty_max; ty++){
+            for (int tx = tx_min; tx <= tx_max; tx++){
+                array_push(tiles[ty * num_tiles_x + tx].triangles, i);
+            }
+        }
+    }
+}
+
+int get_num_tiles(void){
+    return num_tiles_x * num_tiles_y;
+}
+
+const tile_t* get_tile(int index){
+    return &tiles[index];
+}
+
+void free_tiles(void){
+    if (tiles == NULL){
+        return;
+    }
+    for (int i = 0; i < num_tiles_x * num_tiles_y; i++){
+        array_free(tiles[i].triangles);
+    }
+    free(tiles);
+    tiles = NULL;
+}
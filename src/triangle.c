@@ -3,36 +3,87 @@
 #include "draw.h"
 #include "util.h"
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "upng.h"
+#include "array.h"
+#include "profiler.h"
+#include "cpu.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TRIANGLE_X86_SIMD
+#endif
+
+// Dynamic arrays of triangles that should be rendered frame by frame. They are
+// cleared, not freed, every frame, so they only grow until the largest frame fits.
+// Double buffered: the geometry stage fills the back list while the front list
+// of the previous frame may still be rasterized, swap_triangles_to_render()
+// flips them.
+static screen_triangle_t* triangle_lists[2] = { NULL, NULL };
+static int front_list = 0;
+static int triangles_high_water_mark = 0;
+
+#define BACK_LIST (1 - front_list)
+
+void push_triangle_to_render(const screen_triangle_t* triangle){
+    array_push(triangle_lists[BACK_LIST], *triangle);
+}
 
-// Array of triangles that should be rendered frame by frame
-static triangle_t triangles_to_render[MAX_TRIANGLES_PER_MESH];
-static int num_traingles_to_render;
+// appends a block of triangles at once, e.g. the output of a geometry job
+void append_triangles_to_render(const screen_triangle_t* triangles, int count){
+    if (count <= 0){
+        return;
+    }
+    screen_triangle_t* list = array_hold(triangle_lists[BACK_LIST], count, sizeof(screen_triangle_t));
+    memcpy(&list[array_length(list) - count], triangles, sizeof(screen_triangle_t) * count);
+    triangle_lists[BACK_LIST] = list;
+}
 
-void update_triangles_to_render(int i, triangle_t triangle){
-    triangles_to_render[i] = triangle;
+/**
+ * @brief empties the back list for the next frame.
+ *
+ * @param
+ * @return
+ */
+void clear_triangles_to_render(void){
+    array_clear(triangle_lists[BACK_LIST]);
 }
 
-triangle_t get_triangle_to_render(int i){
-    if (i < MAX_TRIANGLES_PER_MESH){
-        return triangles_to_render[i];
-    }else{
-        triangle_t triangle = {
-            .points = {{0.0, 0.0, 0.0, 0.0}},
-            .textcoords = {{0.0, 0.0}},
-            .color = 0xFF000000
-        };
-        return triangle;
+/**
+ * @brief makes the triangles of the finished geometry stage the ones to
+ *        render, and keeps their high water mark.
+ *
+ * @param
+ * @return
+ */
+void swap_triangles_to_render(void){
+    front_list = 1 - front_list;
+    int num = array_length(triangle_lists[front_list]);
+    if (num > triangles_high_water_mark){
+        triangles_high_water_mark = num;
     }
-
 }
 
-void set_num_triangles_to_render(int num){
-    num_traingles_to_render = num;
+// the front list, to rasterize
+const screen_triangle_t* get_triangles_to_render(void){
+    return triangle_lists[front_list];
 }
 
 int get_num_triangles_to_render(void){
-    return num_traingles_to_render;
+    return array_length(triangle_lists[front_list]);
+}
+
+// the largest number of triangles of one frame so far
+int get_triangles_high_water_mark(void){
+    return triangles_high_water_mark;
+}
+
+void free_triangles_to_render(void){
+    for (int i = 0; i < 2; i++){
+        array_free(triangle_lists[i]);
+        triangle_lists[i] = NULL;
+    }
 }
 
 
@@ -74,8 +125,11 @@ void draw_triangle_pixel(int x, int y,
     /*     z_buffer[(window_width * y) + x] = interpolated_reciprocal_zNDC; */
     /* } */
 
+    PROFILE_COUNT(PROF_PIXELS_TESTED, 1);
+
     // Only draw the pixel if the depth value is less than the one previously stored in the z-buffer.
     if (interpolated_reciprocal_w < z_buffer[(window_width * y) + x]){
+        PROFILE_COUNT(PROF_PIXELS_WRITTEN, 1);
 
         // Draw a pixel at position (x, y) with the color that comes from the mapped
         // texture
@@ -93,16 +147,29 @@ void draw_triangle_pixel(int x, int y,
  * @return
  */
 void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, color_t color, int window_width, int window_height, color_t* color_buffer) {
+    rect_t viewport = { 0, 0, window_width - 1, window_height - 1 };
+    draw_triangle_clipped(x0, y0, x1, y1, x2, y2, color, &viewport, window_width, window_height, color_buffer);
+}
+
+/**
+ * @brief renders the pixels of a wireframe triangle that are inside of the
+ *        clip rectangle, see draw_triangle().
+ *
+ * @param clip: rectangle within the color buffer
+ * @return
+ */
+void draw_triangle_clipped(int x0, int y0, int x1, int y1, int x2, int y2, color_t color, const rect_t* clip,
+                           int window_width, int window_height, color_t* color_buffer) {
 
     // dots
-    draw_rectangle(x0, y0, 3, 3, color, window_width, window_height, color_buffer);
-    draw_rectangle(x1, y1, 3, 3, color, window_width, window_height, color_buffer);
-    draw_rectangle(x2, y2, 3, 3, color, window_width, window_height, color_buffer);
+    draw_rectangle_clipped(x0, y0, 3, 3, color, clip, window_width, window_height, color_buffer);
+    draw_rectangle_clipped(x1, y1, 3, 3, color, clip, window_width, window_height, color_buffer);
+    draw_rectangle_clipped(x2, y2, 3, 3, color, clip, window_width, window_height, color_buffer);
 
     // draw all edges (wireframes)
-    draw_line(x0, y0, x1, y1, color, window_width, window_height, color_buffer);
-    draw_line(x1, y1, x2, y2, color, window_width, window_height, color_buffer);
-    draw_line(x2, y2, x0, y0, color, window_width, window_height, color_buffer);
+    draw_line_clipped(x0, y0, x1, y1, color, clip, window_width, color_buffer);
+    draw_line_clipped(x1, y1, x2, y2, color, clip, window_width, color_buffer);
+    draw_line_clipped(x2, y2, x0, y0, color, clip, window_width, color_buffer);
 }
 
 /**
@@ -166,7 +233,10 @@ void draw_textured_triangle(int x0, int y0, float z0, float w0, tex2_t uv_a,
     if (y2 - y0 != 0) inv_slope2 = (float)(x2 - x0) / abs(y2 - y0);
 
     if (y1 - y0 != 0){
-      for (int y = y0; y <= y1; y++) {// starting from top to y1: upper part of the triangle
+      // Clamp the scanlines to the viewport, guard band triangles reach beyond it
+      int y_first = y0 < 0 ? 0 : y0;
+      int y_last = y1 < window_height ? y1 : window_height - 1;
+      for (int y = y_first; y <= y_last; y++) {// starting from top to y1: upper part of the triangle
 
         int x_start = x1 + (y - y1) * inv_slope1;
         int x_end = x0 + (y - y0) * inv_slope2;
@@ -175,6 +245,8 @@ void draw_textured_triangle(int x0, int y0, float z0, float w0, tex2_t uv_a,
           // swap if x_start is to the right of x_end
           int_swap(&x_start, &x_end);
         }
+        if (x_start < 0) x_start = 0;
+        if (x_end > window_width) x_end = window_width;
 
         // draw_line() doesn't work here. We go pixel-by-pixel
         for (int x = x_start; x < x_end; x++) {
@@ -194,7 +266,10 @@ void draw_textured_triangle(int x0, int y0, float z0, float w0, tex2_t uv_a,
     if (y2 - y0 != 0) inv_slope2 = (float)(x2 - x0) / abs(y2 - y0);
 
     if (y2 - y1 != 0){
-      for (int y = y1; y <= y2; y++) {// starting from top to y1: upper part of the triangle
+      // Clamp the scanlines to the viewport, guard band triangles reach beyond it
+      int y_first = y1 < 0 ? 0 : y1;
+      int y_last = y2 < window_height ? y2 : window_height - 1;
+      for (int y = y_first; y <= y_last; y++) {// starting from top to y1: upper part of the triangle
         int x_start = x1 + (y - y1) * inv_slope1;
         int x_end = x0 + (y - y0) * inv_slope2;
 
@@ -202,6 +277,8 @@ void draw_textured_triangle(int x0, int y0, float z0, float w0, tex2_t uv_a,
           // swap if x_start is to the right of x_end
           int_swap(&x_start, &x_end);
         }
+        if (x_start < 0) x_start = 0;
+        if (x_end > window_width) x_end = window_width;
 
         // draw_line() doesn't work here. We go pixel-by-pixel
         for (int x = x_start; x < x_end; x++) {
@@ -378,7 +455,10 @@ void draw_filled_triangle(int x0, int y0, float z0, float w0,
     if (y2 - y0 != 0) inv_slope2 = (float)(x2 - x0) / abs(y2 - y0);
 
     if (y1 - y0 != 0){
-      for (int y = y0; y <= y1; y++) {// starting from top to y1: upper part of the triangle
+      // Clamp the scanlines to the viewport, guard band triangles reach beyond it
+      int y_first = y0 < 0 ? 0 : y0;
+      int y_last = y1 < window_height ? y1 : window_height - 1;
+      for (int y = y_first; y <= y_last; y++) {// starting from top to y1: upper part of the triangle
 
         int x_start = x1 + (y - y1) * inv_slope1;
         int x_end = x0 + (y - y0) * inv_slope2;
@@ -387,6 +467,8 @@ void draw_filled_triangle(int x0, int y0, float z0, float w0,
           // swap if x_start is to the right of x_end
           int_swap(&x_start, &x_end);
         }
+        if (x_start < 0) x_start = 0;
+        if (x_end > window_width) x_end = window_width;
 
         // draw_line() doesn't work here. We go pixel-by-pixel
         for (int x = x_start; x < x_end; x++) {
@@ -406,7 +488,10 @@ void draw_filled_triangle(int x0, int y0, float z0, float w0,
     if (y2 - y0 != 0) inv_slope2 = (float)(x2 - x0) / abs(y2 - y0);
 
     if (y2 - y1 != 0){
-      for (int y = y1; y <= y2; y++) {// starting from top to y1: upper part of the triangle
+      // Clamp the scanlines to the viewport, guard band triangles reach beyond it
+      int y_first = y1 < 0 ? 0 : y1;
+      int y_last = y2 < window_height ? y2 : window_height - 1;
+      for (int y = y_first; y <= y_last; y++) {// starting from top to y1: upper part of the triangle
         int x_start = x1 + (y - y1) * inv_slope1;
         int x_end = x0 + (y - y0) * inv_slope2;
 
@@ -414,6 +499,8 @@ void draw_filled_triangle(int x0, int y0, float z0, float w0,
           // swap if x_start is to the right of x_end
           int_swap(&x_start, &x_end);
         }
+        if (x_start < 0) x_start = 0;
+        if (x_end > window_width) x_end = window_width;
 
         // draw_line() doesn't work here. We go pixel-by-pixel
         for (int x = x_start; x < x_end; x++) {
@@ -425,6 +512,627 @@ void draw_filled_triangle(int x0, int y0, float z0, float w0,
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Edge function rasterizer
+///////////////////////////////////////////////////////////////////////////////
+// Every pixel center of the bounding box is tested against the three integer
+// edge functions of the triangle, see edge.h. 1/w and the perspective divided
+// texture coordinates are plane equations in screen space as well, so the
+// setup computes their value at the first pixel and their steps in x and y
+// once per triangle.
+///////////////////////////////////////////////////////////////////////////////
+// Each row of the bounding box is one span. With SSE or AVX2 the span kernels
+// evaluate 4 or 8 adjacent pixels at once with int32 edge functions and blend
+// the covered, visible ones into the color and z-buffer; the scalar kernel
+// does the remaining pixels, or all of them without SIMD. Attributes are
+// evaluated as value + column * dx in every kernel instead of being summed up,
+// so all kernels write exactly the same pixels.
+///////////////////////////////////////////////////////////////////////////////
+// Bounding boxes larger than a block are rasterized hierarchically: each 8x8
+// block is classified by the edge values at its corners first. Blocks outside
+// of one edge are skipped, blocks inside of all three are drawn without edge
+// tests by the scalar kernel, and only the partially covered ones test every
+// pixel.
+///////////////////////////////////////////////////////////////////////////////
+
+#define BLOCK_SIZE 8
+
+enum block_coverage {
+    BLOCK_OUTSIDE,
+    BLOCK_PARTIAL,
+    BLOCK_COVERED
+};
+
+typedef struct {
+    float value; // at the center of the origin pixel, see edge_setup_t
+    float dx;    // step to the next pixel in x
+    float dy;    // step to the next row
+} plane_eq_t;
+
+typedef struct {
+    int x_origin;           // columns count from the origin of the setup
+    int x;                  // next pixel of the span
+    int x_end;              // last pixel of the span
+    int64_t w[3];           // edge values at pixel x
+    const edge_fn_t* edges;
+    float inv_w;            // attributes at x_origin
+    float u_w;
+    float v_w;
+    color_t* color_row;     // color and z-buffer row of the span
+    float* z_row;
+    bool is_covered;        // every pixel is inside, skip the edge tests
+} span_t;
+
+typedef struct {
+    plane_eq_t inv_w;
+    plane_eq_t u;                   // u/w and v/w, textured only
+    plane_eq_t v;
+    color_t color;                  // flat shaded only
+    const uint32_t* texture_buffer; // NULL for flat shading
+    int texture_width;
+    int texture_height;
+    int simd_level;
+} span_shader_t;
+
+/**
+ * @brief builds the plane equation of a vertex attribute, it interpolates the
+ *        attribute with the barycentric weights edges[i] / area. The top-left
+ *        bias is taken out again, so attributes stay exact on the edges.
+ *
+ * @param setup: triangle setup
+ *        attribute: values at the vertices, in the order of the screen triangle
+ * @return
+ */
+static plane_eq_t setup_attribute(const edge_setup_t* setup, const float attribute[3]){
+    plane_eq_t plane = { 0, 0, 0 };
+    float inv_area = 1.0 / (double)setup->area;
+    for (int i = 0; i < 3; i++){
+        const edge_fn_t* e = &setup->edges[i];
+        float a = attribute[setup->order[i]] * inv_area;
+        plane.value += a * (float)(e->value - e->bias);
+        plane.dx += a * (float)e->dx;
+        plane.dy += a * (float)e->dy;
+    }
+    return plane;
+}
+
+/**
+ * @brief starts the span of the pixels x_first to x_last of a row.
+ */
+static span_t begin_span(const edge_setup_t* setup, const span_shader_t* shader, int y, int x_first, int x_last,
+                         int window_width, color_t* color_buffer, float* z_buffer){
+    int row = y - setup->y_origin;
+    int col = x_first - setup->x_origin;
+    span_t span;
+    span.x_origin = setup->x_origin;
+    span.x = x_first;
+    span.x_end = x_last;
+    span.edges = setup->edges;
+    for (int i = 0; i < 3; i++){
+        span.w[i] = setup->edges[i].value + row * setup->edges[i].dy + col * setup->edges[i].dx;
+    }
+    span.inv_w = shader->inv_w.value + row * shader->inv_w.dy;
+    span.u_w = shader->u.value + row * shader->u.dy;
+    span.v_w = shader->v.value + row * shader->v.dy;
+    span.color_row = color_buffer + window_width * y;
+    span.z_row = z_buffer + window_width * y;
+    span.is_covered = false;
+    return span;
+}
+
+/**
+ * @brief returns the texel of perspective divided texture coordinates.
+ */
+static inline color_t sample_texel(float u_w, float v_w, float reciprocal_w,
+                                   const uint32_t* texture_buffer, int texture_width, int texture_height){
+    int tex_x = abs((int)(u_w / reciprocal_w * texture_width)) % texture_width;
+    int tex_y = abs((int)(v_w / reciprocal_w * texture_height)) % texture_height;
+    return texture_buffer[texture_width * tex_y + tex_x];
+}
+
+static void fill_span_scalar(span_t* span, const span_shader_t* shader){
+    float inv_w_dx = shader->inv_w.dx;
+    color_t color = shader->color;
+    int64_t w0 = span->w[0], w1 = span->w[1], w2 = span->w[2];
+    int64_t dx0 = span->edges[0].dx, dx1 = span->edges[1].dx, dx2 = span->edges[2].dx;
+    float inv_w = span->inv_w;
+    color_t* color_row = span->color_row;
+    float* z_row = span->z_row;
+    bool is_covered = span->is_covered;
+    // column as float, exact up to 2^24 pixels
+    float col = (float)(span->x - span->x_origin);
+    for (int x = span->x, x_end = span->x_end; x <= x_end; x++, col += 1.0f){
+        if (is_covered || (w0 | w1 | w2) >= 0){
+            PROFILE_COUNT(PROF_PIXELS_TESTED, 1);
+            float depth = 1.0f - (inv_w + col * inv_w_dx);
+            if (depth < z_row[x]){
+                PROFILE_COUNT(PROF_PIXELS_WRITTEN, 1);
+                color_row[x] = color;
+                z_row[x] = depth;
+            }
+        }
+        w0 += dx0;
+        w1 += dx1;
+        w2 += dx2;
+    }
+    span->x = span->x_end + 1;
+    span->w[0] = w0;
+    span->w[1] = w1;
+    span->w[2] = w2;
+}
+
+static void texture_span_scalar(span_t* span, const span_shader_t* shader){
+    const plane_eq_t* inv_w = &shader->inv_w;
+    const plane_eq_t* u = &shader->u;
+    const plane_eq_t* v = &shader->v;
+    const uint32_t* texture_buffer = shader->texture_buffer;
+    int texture_width = shader->texture_width;
+    int texture_height = shader->texture_height;
+    int64_t w0 = span->w[0], w1 = span->w[1], w2 = span->w[2];
+    int64_t dx0 = span->edges[0].dx, dx1 = span->edges[1].dx, dx2 = span->edges[2].dx;
+    float inv_w_row = span->inv_w, inv_w_dx = inv_w->dx;
+    float u_w_row = span->u_w, u_dx = u->dx;
+    float v_w_row = span->v_w, v_dx = v->dx;
+    color_t* color_row = span->color_row;
+    float* z_row = span->z_row;
+    bool is_covered = span->is_covered;
+    float col = (float)(span->x - span->x_origin);
+    for (int x = span->x, x_end = span->x_end; x <= x_end; x++, col += 1.0f){
+        if (is_covered || (w0 | w1 | w2) >= 0){
+            PROFILE_COUNT(PROF_PIXELS_TESTED, 1);
+            float reciprocal_w = inv_w_row + col * inv_w_dx;
+            float depth = 1.0f - reciprocal_w;
+            if (depth < z_row[x]){
+                PROFILE_COUNT(PROF_PIXELS_WRITTEN, 1);
+                float u_w = u_w_row + col * u_dx;
+                float v_w = v_w_row + col * v_dx;
+                color_row[x] = sample_texel(u_w, v_w, reciprocal_w, texture_buffer, texture_width, texture_height);
+                z_row[x] = depth;
+            }
+        }
+        w0 += dx0;
+        w1 += dx1;
+        w2 += dx2;
+    }
+    span->x = span->x_end + 1;
+    span->w[0] = w0;
+    span->w[1] = w1;
+    span->w[2] = w2;
+}
+
+#ifdef TRIANGLE_X86_SIMD
+/**
+ * @brief advances the span by n pixels after a SIMD kernel.
+ */
+static void skip_span(span_t* span, int n){
+    for (int i = 0; i < 3; i++){
+        span->w[i] += n * span->edges[i].dx;
+    }
+    span->x += n;
+}
+
+__attribute__((target("sse4.1")))
+static void fill_span_sse(span_t* span, const span_shader_t* shader){
+    float inv_w_dx = shader->inv_w.dx;
+    color_t color = shader->color;
+    const edge_fn_t* e = span->edges;
+    __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i w0 = _mm_add_epi32(_mm_set1_epi32((int32_t)span->w[0]), _mm_mullo_epi32(lane, _mm_set1_epi32((int32_t)e[0].dx)));
+    __m128i w1 = _mm_add_epi32(_mm_set1_epi32((int32_t)span->w[1]), _mm_mullo_epi32(lane, _mm_set1_epi32((int32_t)e[1].dx)));
+    __m128i w2 = _mm_add_epi32(_mm_set1_epi32((int32_t)span->w[2]), _mm_mullo_epi32(lane, _mm_set1_epi32((int32_t)e[2].dx)));
+    __m128i step0 = _mm_set1_epi32((int32_t)(4 * e[0].dx));
+    __m128i step1 = _mm_set1_epi32((int32_t)(4 * e[1].dx));
+    __m128i step2 = _mm_set1_epi32((int32_t)(4 * e[2].dx));
+    __m128i column = _mm_add_epi32(_mm_set1_epi32(span->x - span->x_origin), lane);
+    __m128i covered = _mm_set1_epi32(span->is_covered ? -1 : 0);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 inv_w = _mm_set1_ps(span->inv_w);
+    __m128 dx = _mm_set1_ps(inv_w_dx);
+    __m128i fill = _mm_set1_epi32((int32_t)color);
+
+    int x = span->x;
+    for (; x + 4 <= span->x_end + 1; x += 4){
+        __m128i inside = _mm_or_si128(_mm_cmpgt_epi32(_mm_or_si128(_mm_or_si128(w0, w1), w2), _mm_set1_epi32(-1)), covered);
+        if (_mm_movemask_ps(_mm_castsi128_ps(inside))){
+            PROFILE_COUNT(PROF_PIXELS_TESTED, __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(inside))));
+            __m128 depth = _mm_sub_ps(one, _mm_add_ps(inv_w, _mm_mul_ps(_mm_cvtepi32_ps(column), dx)));
+            __m128 z = _mm_loadu_ps(span->z_row + x);
+            __m128 mask = _mm_and_ps(_mm_castsi128_ps(inside), _mm_cmplt_ps(depth, z));
+            if (_mm_movemask_ps(mask)){
+                PROFILE_COUNT(PROF_PIXELS_WRITTEN, __builtin_popcount(_mm_movemask_ps(mask)));
+                __m128i c = _mm_loadu_si128((const __m128i*)(span->color_row + x));
+                _mm_storeu_si128((__m128i*)(span->color_row + x), _mm_blendv_epi8(c, fill, _mm_castps_si128(mask)));
+                _mm_storeu_ps(span->z_row + x, _mm_blendv_ps(z, depth, mask));
+            }
+        }
+        w0 = _mm_add_epi32(w0, step0);
+        w1 = _mm_add_epi32(w1, step1);
+        w2 = _mm_add_epi32(w2, step2);
+        column = _mm_add_epi32(column, _mm_set1_epi32(4));
+    }
+    skip_span(span, x - span->x);
+}
+
+__attribute__((target("sse4.1")))
+static void texture_span_sse(span_t* span, const span_shader_t* shader){
+    const plane_eq_t* inv_w = &shader->inv_w;
+    const plane_eq_t* u = &shader->u;
+    const plane_eq_t* v = &shader->v;
+    const uint32_t* texture_buffer = shader->texture_buffer;
+    int texture_width = shader->texture_width;
+    int texture_height = shader->texture_height;
+    const edge_fn_t* e = span->edges;
+    __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i w0 = _mm_add_epi32(_mm_set1_epi32((int32_t)span->w[0]), _mm_mullo_epi32(lane, _mm_set1_epi32((int32_t)e[0].dx)));
+    __m128i w1 = _mm_add_epi32(_mm_set1_epi32((int32_t)span->w[1]), _mm_mullo_epi32(lane, _mm_set1_epi32((int32_t)e[1].dx)));
+    __m128i w2 = _mm_add_epi32(_mm_set1_epi32((int32_t)span->w[2]), _mm_mullo_epi32(lane, _mm_set1_epi32((int32_t)e[2].dx)));
+    __m128i step0 = _mm_set1_epi32((int32_t)(4 * e[0].dx));
+    __m128i step1 = _mm_set1_epi32((int32_t)(4 * e[1].dx));
+    __m128i step2 = _mm_set1_epi32((int32_t)(4 * e[2].dx));
+    __m128i column = _mm_add_epi32(_mm_set1_epi32(span->x - span->x_origin), lane);
+    __m128i covered = _mm_set1_epi32(span->is_covered ? -1 : 0);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 tex_size_x = _mm_set1_ps((float)texture_width);
+    __m128 tex_size_y = _mm_set1_ps((float)texture_height);
+
+    int x = span->x;
+    for (; x + 4 <= span->x_end + 1; x += 4){
+        __m128i inside = _mm_or_si128(_mm_cmpgt_epi32(_mm_or_si128(_mm_or_si128(w0, w1), w2), _mm_set1_epi32(-1)), covered);
+        if (_mm_movemask_ps(_mm_castsi128_ps(inside))){
+            PROFILE_COUNT(PROF_PIXELS_TESTED, __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(inside))));
+            __m128 col = _mm_cvtepi32_ps(column);
+            __m128 reciprocal_w = _mm_add_ps(_mm_set1_ps(span->inv_w), _mm_mul_ps(col, _mm_set1_ps(inv_w->dx)));
+            __m128 depth = _mm_sub_ps(one, reciprocal_w);
+            __m128 z = _mm_loadu_ps(span->z_row + x);
+            __m128 mask = _mm_and_ps(_mm_castsi128_ps(inside), _mm_cmplt_ps(depth, z));
+            int bits = _mm_movemask_ps(mask);
+            if (bits){
+                PROFILE_COUNT(PROF_PIXELS_WRITTEN, __builtin_popcount(bits));
+                __m128 u_w = _mm_add_ps(_mm_set1_ps(span->u_w), _mm_mul_ps(col, _mm_set1_ps(u->dx)));
+                __m128 v_w = _mm_add_ps(_mm_set1_ps(span->v_w), _mm_mul_ps(col, _mm_set1_ps(v->dx)));
+                int32_t tex_x[4], tex_y[4];
+                _mm_storeu_si128((__m128i*)tex_x, _mm_abs_epi32(_mm_cvttps_epi32(_mm_mul_ps(_mm_div_ps(u_w, reciprocal_w), tex_size_x))));
+                _mm_storeu_si128((__m128i*)tex_y, _mm_abs_epi32(_mm_cvttps_epi32(_mm_mul_ps(_mm_div_ps(v_w, reciprocal_w), tex_size_y))));
+                for (int i = 0; i < 4; i++){
+                    if (bits & (1 << i)){
+                        span->color_row[x + i] = texture_buffer[texture_width * (tex_y[i] % texture_height) + tex_x[i] % texture_width];
+                    }
+                }
+                _mm_storeu_ps(span->z_row + x, _mm_blendv_ps(z, depth, mask));
+            }
+        }
+        w0 = _mm_add_epi32(w0, step0);
+        w1 = _mm_add_epi32(w1, step1);
+        w2 = _mm_add_epi32(w2, step2);
+        column = _mm_add_epi32(column, _mm_set1_epi32(4));
+    }
+    skip_span(span, x - span->x);
+}
+
+__attribute__((target("avx2")))
+static void fill_span_avx2(span_t* span, const span_shader_t* shader){
+    float inv_w_dx = shader->inv_w.dx;
+    color_t color = shader->color;
+    const edge_fn_t* e = span->edges;
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i w0 = _mm256_add_epi32(_mm256_set1_epi32((int32_t)span->w[0]), _mm256_mullo_epi32(lane, _mm256_set1_epi32((int32_t)e[0].dx)));
+    __m256i w1 = _mm256_add_epi32(_mm256_set1_epi32((int32_t)span->w[1]), _mm256_mullo_epi32(lane, _mm256_set1_epi32((int32_t)e[1].dx)));
+    __m256i w2 = _mm256_add_epi32(_mm256_set1_epi32((int32_t)span->w[2]), _mm256_mullo_epi32(lane, _mm256_set1_epi32((int32_t)e[2].dx)));
+    __m256i step0 = _mm256_set1_epi32((int32_t)(8 * e[0].dx));
+    __m256i step1 = _mm256_set1_epi32((int32_t)(8 * e[1].dx));
+    __m256i step2 = _mm256_set1_epi32((int32_t)(8 * e[2].dx));
+    __m256i column = _mm256_add_epi32(_mm256_set1_epi32(span->x - span->x_origin), lane);
+    __m256i covered = _mm256_set1_epi32(span->is_covered ? -1 : 0);
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 inv_w = _mm256_set1_ps(span->inv_w);
+    __m256 dx = _mm256_set1_ps(inv_w_dx);
+    __m256i fill = _mm256_set1_epi32((int32_t)color);
+
+    int x = span->x;
+    for (; x + 8 <= span->x_end + 1; x += 8){
+        __m256i inside = _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_or_si256(_mm256_or_si256(w0, w1), w2), _mm256_set1_epi32(-1)), covered);
+        if (_mm256_movemask_ps(_mm256_castsi256_ps(inside))){
+            PROFILE_COUNT(PROF_PIXELS_TESTED, __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(inside))));
+            __m256 depth = _mm256_sub_ps(one, _mm256_add_ps(inv_w, _mm256_mul_ps(_mm256_cvtepi32_ps(column), dx)));
+            __m256 z = _mm256_loadu_ps(span->z_row + x);
+            __m256 mask = _mm256_and_ps(_mm256_castsi256_ps(inside), _mm256_cmp_ps(depth, z, _CMP_LT_OQ));
+            if (_mm256_movemask_ps(mask)){
+                PROFILE_COUNT(PROF_PIXELS_WRITTEN, __builtin_popcount(_mm256_movemask_ps(mask)));
+                __m256i c = _mm256_loadu_si256((const __m256i*)(span->color_row + x));
+                _mm256_storeu_si256((__m256i*)(span->color_row + x), _mm256_blendv_epi8(c, fill, _mm256_castps_si256(mask)));
+                _mm256_storeu_ps(span->z_row + x, _mm256_blendv_ps(z, depth, mask));
+            }
+        }
+        w0 = _mm256_add_epi32(w0, step0);
+        w1 = _mm256_add_epi32(w1, step1);
+        w2 = _mm256_add_epi32(w2, step2);
+        column = _mm256_add_epi32(column, _mm256_set1_epi32(8));
+    }
+    skip_span(span, x - span->x);
+}
+
+__attribute__((target("avx2")))
+static void texture_span_avx2(span_t* span, const span_shader_t* shader){
+    const plane_eq_t* inv_w = &shader->inv_w;
+    const plane_eq_t* u = &shader->u;
+    const plane_eq_t* v = &shader->v;
+    const uint32_t* texture_buffer = shader->texture_buffer;
+    int texture_width = shader->texture_width;
+    int texture_height = shader->texture_height;
+    const edge_fn_t* e = span->edges;
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i w0 = _mm256_add_epi32(_mm256_set1_epi32((int32_t)span->w[0]), _mm256_mullo_epi32(lane, _mm256_set1_epi32((int32_t)e[0].dx)));
+    __m256i w1 = _mm256_add_epi32(_mm256_set1_epi32((int32_t)span->w[1]), _mm256_mullo_epi32(lane, _mm256_set1_epi32((int32_t)e[1].dx)));
+    __m256i w2 = _mm256_add_epi32(_mm256_set1_epi32((int32_t)span->w[2]), _mm256_mullo_epi32(lane, _mm256_set1_epi32((int32_t)e[2].dx)));
+    __m256i step0 = _mm256_set1_epi32((int32_t)(8 * e[0].dx));
+    __m256i step1 = _mm256_set1_epi32((int32_t)(8 * e[1].dx));
+    __m256i step2 = _mm256_set1_epi32((int32_t)(8 * e[2].dx));
+    __m256i column = _mm256_add_epi32(_mm256_set1_epi32(span->x - span->x_origin), lane);
+    __m256i covered = _mm256_set1_epi32(span->is_covered ? -1 : 0);
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 tex_size_x = _mm256_set1_ps((float)texture_width);
+    __m256 tex_size_y = _mm256_set1_ps((float)texture_height);
+
+    // Power of two textures wrap with a mask and fetch with one gather
+    bool is_pow2 = (texture_width & (texture_width - 1)) == 0 && (texture_height & (texture_height - 1)) == 0;
+    __m256i wrap_x = _mm256_set1_epi32(texture_width - 1);
+    __m256i wrap_y = _mm256_set1_epi32(texture_height - 1);
+
+    int x = span->x;
+    for (; x + 8 <= span->x_end + 1; x += 8){
+        __m256i inside = _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_or_si256(_mm256_or_si256(w0, w1), w2), _mm256_set1_epi32(-1)), covered);
+        if (_mm256_movemask_ps(_mm256_castsi256_ps(inside))){
+            PROFILE_COUNT(PROF_PIXELS_TESTED, __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(inside))));
+            __m256 col = _mm256_cvtepi32_ps(column);
+            __m256 reciprocal_w = _mm256_add_ps(_mm256_set1_ps(span->inv_w), _mm256_mul_ps(col, _mm256_set1_ps(inv_w->dx)));
+            __m256 depth = _mm256_sub_ps(one, reciprocal_w);
+            __m256 z = _mm256_loadu_ps(span->z_row + x);
+            __m256 mask = _mm256_and_ps(_mm256_castsi256_ps(inside), _mm256_cmp_ps(depth, z, _CMP_LT_OQ));
+            int bits = _mm256_movemask_ps(mask);
+            if (bits){
+                PROFILE_COUNT(PROF_PIXELS_WRITTEN, __builtin_popcount(bits));
+                __m256 u_w = _mm256_add_ps(_mm256_set1_ps(span->u_w), _mm256_mul_ps(col, _mm256_set1_ps(u->dx)));
+                __m256 v_w = _mm256_add_ps(_mm256_set1_ps(span->v_w), _mm256_mul_ps(col, _mm256_set1_ps(v->dx)));
+                __m256i tex_x = _mm256_abs_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(_mm256_div_ps(u_w, reciprocal_w), tex_size_x)));
+                __m256i tex_y = _mm256_abs_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(_mm256_div_ps(v_w, reciprocal_w), tex_size_y)));
+                if (is_pow2){
+                    __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(tex_y, wrap_y), _mm256_set1_epi32(texture_width)),
+                                                     _mm256_and_si256(tex_x, wrap_x));
+                    __m256i c = _mm256_loadu_si256((const __m256i*)(span->color_row + x));
+                    __m256i texel = _mm256_mask_i32gather_epi32(c, (const int*)texture_buffer, index, _mm256_castps_si256(mask), 4);
+                    _mm256_storeu_si256((__m256i*)(span->color_row + x), texel);
+                } else {
+                    int32_t lane_x[8], lane_y[8];
+                    _mm256_storeu_si256((__m256i*)lane_x, tex_x);
+                    _mm256_storeu_si256((__m256i*)lane_y, tex_y);
+                    for (int i = 0; i < 8; i++){
+                        if (bits & (1 << i)){
+                            span->color_row[x + i] = texture_buffer[texture_width * (lane_y[i] % texture_height) + lane_x[i] % texture_width];
+                        }
+                    }
+                }
+                _mm256_storeu_ps(span->z_row + x, _mm256_blendv_ps(z, depth, mask));
+            }
+        }
+        w0 = _mm256_add_epi32(w0, step0);
+        w1 = _mm256_add_epi32(w1, step1);
+        w2 = _mm256_add_epi32(w2, step2);
+        column = _mm256_add_epi32(column, _mm256_set1_epi32(8));
+    }
+    skip_span(span, x - span->x);
+}
+#endif
+
+/**
+ * @brief draws a span with the kernels of the shader's SIMD level, flat shaded
+ *        or textured.
+ */
+static void draw_span(span_t* span, const span_shader_t* shader){
+#ifdef TRIANGLE_X86_SIMD
+    switch (shader->simd_level){
+    case SIMD_AVX2:
+        if (shader->texture_buffer){
+            texture_span_avx2(span, shader);
+        } else {
+            fill_span_avx2(span, shader);
+        }
+        break;
+    case SIMD_SSE:
+        if (shader->texture_buffer){
+            texture_span_sse(span, shader);
+        } else {
+            fill_span_sse(span, shader);
+        }
+        break;
+    }
+#endif
+    // remaining pixels, or all of them without SIMD
+    if (shader->texture_buffer){
+        texture_span_scalar(span, shader);
+    } else {
+        fill_span_scalar(span, shader);
+    }
+}
+
+/**
+ * @brief classifies the pixels x0 to x1, y0 to y1 of the bounding box against
+ *        the edges. Edge functions are linear, so their minimum and maximum
+ *        over the block are at its corner pixels.
+ *
+ * @return one of enum block_coverage
+ */
+static int classify_block(const edge_setup_t* setup, int x0, int y0, int x1, int y1){
+    int coverage = BLOCK_COVERED;
+    for (int i = 0; i < 3; i++){
+        const edge_fn_t* e = &setup->edges[i];
+        int64_t w = e->value + (y0 - setup->y_origin) * e->dy + (x0 - setup->x_origin) * e->dx;
+        int64_t step_x = (x1 - x0) * e->dx;
+        int64_t step_y = (y1 - y0) * e->dy;
+        int64_t w_min = w + (step_x < 0 ? step_x : 0) + (step_y < 0 ? step_y : 0);
+        int64_t w_max = w + (step_x > 0 ? step_x : 0) + (step_y > 0 ? step_y : 0);
+        if (w_max < 0){
+            return BLOCK_OUTSIDE;
+        }
+        if (w_min < 0){
+            coverage = BLOCK_PARTIAL;
+        }
+    }
+    return coverage;
+}
+
+/**
+ * @brief rasterizes a set up triangle row by row, or block by block when its
+ *        bounding box is larger than a block.
+ */
+static void rasterize_triangle(const edge_setup_t* setup, const span_shader_t* shader,
+                               int window_width, color_t* color_buffer, float* z_buffer){
+    if (setup->x_max - setup->x_min < BLOCK_SIZE || setup->y_max - setup->y_min < BLOCK_SIZE){
+        for (int y = setup->y_min; y <= setup->y_max; y++){
+            span_t span = begin_span(setup, shader, y, setup->x_min, setup->x_max, window_width, color_buffer, z_buffer);
+            draw_span(&span, shader);
+        }
+        return;
+    }
+
+    // Blocks are aligned to the screen, the ones on the border of the bounding
+    // box are cut by it. The triangle is convex, so in each row of blocks the
+    // blocks that are not outside are one run, and the covered ones within it
+    // as well: each row of pixels is at most a partial, a covered and another
+    // partial span. The SIMD kernels test 4 or 8 pixels in a few instructions,
+    // for them the run is only cut out of the row and drawn as one span: the
+    // split costs more in scalar remainders than the skipped tests save, and
+    // their covered blocks count as partial.
+    bool split_covered = shader->simd_level == SIMD_SCALAR;
+    for (int block_y = setup->y_min & ~(BLOCK_SIZE - 1); block_y <= setup->y_max; block_y += BLOCK_SIZE){
+        int y0 = block_y > setup->y_min ? block_y : setup->y_min;
+        int y1 = block_y + BLOCK_SIZE - 1 < setup->y_max ? block_y + BLOCK_SIZE - 1 : setup->y_max;
+
+        int run_first = -1, run_last = -1;     // pixels of the blocks that are not outside
+        int cover_first = -1, cover_last = -2; // pixels of the covered blocks
+        for (int block_x = setup->x_min & ~(BLOCK_SIZE - 1); block_x <= setup->x_max; block_x += BLOCK_SIZE){
+            int x0 = block_x > setup->x_min ? block_x : setup->x_min;
+            int x1 = block_x + BLOCK_SIZE - 1 < setup->x_max ? block_x + BLOCK_SIZE - 1 : setup->x_max;
+            int coverage = classify_block(setup, x0, y0, x1, y1);
+            if (coverage == BLOCK_OUTSIDE){
+                PROFILE_COUNT(PROF_BLOCKS_SKIPPED, 1);
+                continue;
+            }
+            if (run_first < 0){
+                run_first = x0;
+            }
+            run_last = x1;
+            if (coverage == BLOCK_COVERED && split_covered){
+                PROFILE_COUNT(PROF_BLOCKS_COVERED, 1);
+                if (cover_first < 0){
+                    cover_first = x0;
+                }
+                cover_last = x1;
+            } else {
+                PROFILE_COUNT(PROF_BLOCKS_PARTIAL, 1);
+            }
+        }
+        if (run_first < 0){
+            continue;
+        }
+        if (cover_first < 0){
+            cover_first = run_last + 1;
+            cover_last = run_last;
+        }
+
+        for (int y = y0; y <= y1; y++){
+            span_t span = begin_span(setup, shader, y, run_first, cover_first - 1, window_width, color_buffer, z_buffer);
+            draw_span(&span, shader);
+            if (cover_first <= cover_last){
+                span.x_end = cover_last;
+                span.is_covered = true;
+                draw_span(&span, shader);
+                span.x_end = run_last;
+                span.is_covered = false;
+                draw_span(&span, shader);
+            }
+        }
+    }
+}
+
+/**
+ * @brief returns the SIMD level the span kernels of a triangle can use: int32
+ *        lanes need edge values that fit 32 bit.
+ */
+static int span_simd_level(const edge_setup_t* setup){
+    return edge_fits_int32(setup) ? cpu_simd_level() : SIMD_SCALAR;
+}
+
+/**
+ * @brief sets up a screen triangle, cut by the scissor rectangle if any.
+ *
+ * @return returns false, when the triangle covers no pixel.
+ */
+static bool setup_screen_triangle(const screen_triangle_t* triangle, const rect_t* scissor,
+                                  int window_width, int window_height, edge_setup_t* setup){
+    if (!edge_setup_triangle(triangle->x, triangle->y, window_width, window_height, setup)){
+        return false;
+    }
+    return scissor == NULL || edge_setup_scissor(setup, scissor->x_min, scissor->y_min, scissor->x_max, scissor->y_max);
+}
+
+/**
+ * @brief draws a flat shaded triangle with incremental edge functions. The
+ *        z-buffer holds 1 - 1/w, like draw_texel().
+ *
+ * @param triangle: screen triangle
+ *        scissor: pixels to draw, e.g. a screen tile, or NULL for all
+ * @return
+ */
+void draw_filled_triangle_edge(const screen_triangle_t* triangle, const rect_t* scissor,
+                               int window_width, int window_height,
+                               color_t* color_buffer, float* z_buffer){
+    edge_setup_t setup;
+    if (!setup_screen_triangle(triangle, scissor, window_width, window_height, &setup)){
+        return;
+    }
+    span_shader_t shader = { 0 };
+    shader.inv_w = setup_attribute(&setup, triangle->inv_w);
+    shader.color = triangle->color;
+    shader.simd_level = span_simd_level(&setup);
+    rasterize_triangle(&setup, &shader, window_width, color_buffer, z_buffer);
+}
+
+/**
+ * @brief draws a perspective correct textured triangle with incremental edge
+ *        functions: u/w, v/w and 1/w are interpolated linearly, u and v
+ *        divided back per pixel.
+ *
+ * @param triangle: screen triangle
+ *        texture: texture of the triangle material
+ *        scissor: pixels to draw, e.g. a screen tile, or NULL for all
+ * @return
+ */
+void draw_textured_triangle_edge(const screen_triangle_t* triangle, upng_t* texture, const rect_t* scissor,
+                                 int window_width, int window_height,
+                                 color_t* color_buffer, float* z_buffer){
+    edge_setup_t setup;
+    if (!setup_screen_triangle(triangle, scissor, window_width, window_height, &setup)){
+        return;
+    }
+
+    // Flip the V component to account for inverted uv_coordinates
+    float u_over_w[3], v_over_w[3];
+    for (int i = 0; i < 3; i++){
+        tex2_t uv = tex2_unpack(triangle->uv[i]);
+        u_over_w[i] = uv.u * triangle->inv_w[i];
+        v_over_w[i] = (1.0 - uv.v) * triangle->inv_w[i];
+    }
+    span_shader_t shader = { 0 };
+    shader.inv_w = setup_attribute(&setup, triangle->inv_w);
+    shader.u = setup_attribute(&setup, u_over_w);
+    shader.v = setup_attribute(&setup, v_over_w);
+    shader.texture_buffer = (const uint32_t*)upng_get_buffer(texture);
+    shader.texture_width = upng_get_width(texture);
+    shader.texture_height = upng_get_height(texture);
+    shader.simd_level = span_simd_level(&setup);
+    rasterize_triangle(&setup, &shader, window_width, color_buffer, z_buffer);
+}
+
 vec3_t get_triangle_normal(vec4_t vertices[3]){
 
     // normal vector for lighting and back-face culling
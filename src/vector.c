@@ -1,5 +1,8 @@
+#define _POSIX_C_SOURCE 200112L // posix_memalign() in -std=c99
 #include "vector.h"
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 // 2D Vector functions
@@ -189,3 +192,53 @@ vec3_t vec3_from_vec4(vec4_t v){
     vec3_t result = {v.x, v.y, v.z};
     return result;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+// Structure-of-arrays functions
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief returns count rounded up to a multiple of the SIMD width.
+ *
+ * @param
+ * @return
+ */
+int soa_padded_count(int count){
+    return (count + SOA_WIDTH - 1) / SOA_WIDTH * SOA_WIDTH;
+}
+
+static float* soa_alloc_floats(int count){
+    void* p = NULL;
+    int padded = soa_padded_count(count > 0 ? count : 1);
+    if (posix_memalign(&p, 32, sizeof(float) * padded) != 0){
+        return NULL;
+    }
+    memset(p, 0, sizeof(float) * padded); // padding stays zero
+    return (float*)p;
+}
+
+/**
+ * @brief allocates 32-byte aligned, zero padded x, y, z (and w) arrays.
+ *
+ * @param soa: the stream to allocate
+ *        count: number of vertices
+ *        with_w: also allocate the w array
+ * @return returns true, when all arrays are allocated.
+ */
+bool vec4_soa_alloc(vec4_soa_t* soa, int count, bool with_w){
+    soa->x = soa_alloc_floats(count);
+    soa->y = soa_alloc_floats(count);
+    soa->z = soa_alloc_floats(count);
+    soa->w = with_w ? soa_alloc_floats(count) : NULL;
+    soa->count = count;
+    return soa->x != NULL && soa->y != NULL && soa->z != NULL && (!with_w || soa->w != NULL);
+}
+
+void vec4_soa_free(vec4_soa_t* soa){
+    free(soa->x);
+    free(soa->y);
+    free(soa->z);
+    free(soa->w);
+    soa->x = soa->y = soa->z = soa->w = NULL;
+    soa->count = 0;
+}